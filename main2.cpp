@@ -10,251 +10,4426 @@
 #include <numeric> // For accumulate
 #include <wx/datectrl.h>
 #include <wx/datetime.h> //date ranges
+#include <wx/notifmsg.h>
+#include <wx/uiaction.h>
 #include <thread>
+#include <functional>
+#include <sstream>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <type_traits>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cmath>
+#include <array>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <atomic>
+#include <filesystem>
+#ifdef __unix__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#endif
 
 
 using namespace std;
 
-class GraphPanel : public wxPanel {
+// Compile-time perfect hashing of the fixed GIOŚ vocabularies (parameter codes,
+// provinces). Strings are mapped to dense enums once at ingest so everything
+// downstream can index plain arrays.
+constexpr uint32_t fnv1a(string_view s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+template <size_t N, size_t M>
+struct PerfectHash {
+    static_assert(N < 255 && (M & (M - 1)) == 0, "table size must be a power of two");
+    array<string_view, N> keys;
+    uint32_t seed = 0;
+    array<uint8_t, M> table{};
+
+    constexpr PerfectHash(const array<string_view, N>& k) : keys(k) {
+        // Try seeds until every key lands in its own bucket
+        for (seed = 0; seed < 1000000; ++seed) {
+            for (auto& t : table)
+                t = 0xFF;
+            bool ok = true;
+            for (size_t i = 0; i < N && ok; ++i) {
+                uint32_t h = fnv1a(keys[i], seed) & (M - 1);
+                if (table[h] != 0xFF)
+                    ok = false;
+                table[h] = static_cast<uint8_t>(i);
+            }
+            if (ok)
+                return;
+        }
+    }
+
+    // Index of the key, or N when the string is not in the vocabulary
+    constexpr size_t find(string_view s) const {
+        uint8_t i = table[fnv1a(s, seed) & (M - 1)];
+        return (i != 0xFF && keys[i] == s) ? i : N;
+    }
+};
+
+enum class Param : uint8_t { PM10, PM25, NO2, O3, SO2, C6H6, CO, Count };
+constexpr size_t kParamCount = static_cast<size_t>(Param::Count);
+constexpr array<string_view, kParamCount> kParamCodes = {"PM10", "PM2.5", "NO2", "O3", "SO2", "C6H6", "CO"};
+constexpr PerfectHash<kParamCount, 16> kParamHash(kParamCodes);
+
+constexpr Param paramFromCode(string_view code) { return static_cast<Param>(kParamHash.find(code)); }
+constexpr size_t paramIndex(Param p) { return static_cast<size_t>(p); }
+
+enum class Province : uint8_t {
+    Dolnoslaskie, KujawskoPomorskie, Lubelskie, Lubuskie, Lodzkie, Malopolskie, Mazowieckie, Opolskie,
+    Podkarpackie, Podlaskie, Pomorskie, Slaskie, Swietokrzyskie, WarminskoMazurskie, Wielkopolskie,
+    Zachodniopomorskie, Count
+};
+constexpr size_t kProvinceCount = static_cast<size_t>(Province::Count);
+// Spelled exactly like provinceName in findAll (upper case UTF-8)
+constexpr array<string_view, kProvinceCount> kProvinceNames = {
+    "DOLNOŚLĄSKIE", "KUJAWSKO-POMORSKIE", "LUBELSKIE", "LUBUSKIE", "ŁÓDZKIE", "MAŁOPOLSKIE", "MAZOWIECKIE", "OPOLSKIE",
+    "PODKARPACKIE", "PODLASKIE", "POMORSKIE", "ŚLĄSKIE", "ŚWIĘTOKRZYSKIE", "WARMIŃSKO-MAZURSKIE", "WIELKOPOLSKIE",
+    "ZACHODNIOPOMORSKIE"};
+constexpr PerfectHash<kProvinceCount, 64> kProvinceHash(kProvinceNames);
+
+constexpr Province provinceFromName(string_view name) { return static_cast<Province>(kProvinceHash.find(name)); }
+
+static_assert(paramFromCode("PM2.5") == Param::PM25 && paramFromCode("pm10") == Param::Count, "param hash");
+static_assert(provinceFromName("ŚLĄSKIE") == Province::Slaskie, "province hash");
+
+// Limit values in µg/m3 (CO included), per parameter: the short-term limit
+// (hourly, daily or 8h depending on the parameter) and the annual one; 0 = none
+struct ParamLimits {
+    double shortTerm;
+    double annual;
+};
+constexpr array<ParamLimits, kParamCount> kParamLimits = {{
+    {50, 40},      // PM10 daily
+    {0, 20},       // PM2.5
+    {200, 40},     // NO2 hourly
+    {120, 0},      // O3 8h target
+    {350, 20},     // SO2 hourly
+    {0, 5},        // C6H6
+    {10000, 0},    // CO 8h
+}};
+
+// Polish air quality index: upper bounds of the first five levels, anything
+// above the last bound is "Very bad"
+constexpr array<string_view, 6> kAqiLevels = {"Very good", "Good", "Moderate", "Sufficient", "Bad", "Very bad"};
+constexpr array<array<double, 5>, kParamCount> kAqiBreakpoints = {{
+    {20, 50, 80, 110, 150},              // PM10
+    {13, 35, 55, 75, 110},               // PM2.5
+    {40, 100, 150, 230, 400},            // NO2
+    {70, 120, 150, 180, 240},            // O3
+    {50, 100, 200, 350, 500},            // SO2
+    {6, 11, 16, 21, 51},                 // C6H6
+    {3000, 7000, 11000, 15000, 21000},   // CO
+}};
+
+constexpr size_t aqiLevel(Param p, double value) {
+    if (p == Param::Count)
+        return kAqiLevels.size();
+    const auto& bounds = kAqiBreakpoints[paramIndex(p)];
+    size_t level = 0;
+    while (level < bounds.size() && value > bounds[level])
+        ++level;
+    return level;
+}
+
+// Locale independent parsing kernels for everything we ingest (coordinates,
+// user input, GIOŚ dates). wxSetlocale() in OnInit must not change how
+// "50.912475" is read, and dates come in one fixed format anyway.
+inline uint64_t load8(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+// True when all 8 bytes are ASCII digits
+inline bool isEightDigits(uint64_t v) {
+    return ((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+           0x3333333333333333ULL;
+}
+
+// "12345678" -> 12345678 with three multiplications (SWAR)
+inline uint32_t parseEightDigits(uint64_t v) {
+    const uint64_t mask = 0x000000FF000000FFULL;
+    const uint64_t mul1 = 0x000F424000000064ULL; // 100 + (1000000 << 32)
+    const uint64_t mul2 = 0x0000271000000001ULL; // 1 + (10000 << 32)
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+    return static_cast<uint32_t>(v);
+}
+
+inline bool isDigit(char c) { return static_cast<unsigned char>(c - '0') < 10; }
+
+// Parses a decimal like "-50.912475" or "1.5e-3" from [p, end). Returns the
+// position after the number, or nullptr if there is none. Numbers that fit
+// the exact double path (<= 2^53 mantissa, |exp| <= 22) never leave this
+// function, everything else goes through from_chars.
+inline const char* parseDecimal(const char* p, const char* end, double& out) {
+    static constexpr double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char* start = p;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    const char* numberStart = p;
+    uint64_t mantissa = 0;
+    int digits = 0;      // significant digits kept in mantissa
+    int exponent = 0;
+    bool truncated = false;
+    bool any = false;
+
+    auto takeDigits = [&](bool fraction) {
+        while (end - p >= 8 && digits + 8 <= 19 && isEightDigits(load8(p))) {
+            mantissa = mantissa * 100000000 + parseEightDigits(load8(p));
+            if (mantissa)
+                digits += 8;
+            if (fraction)
+                exponent -= 8;
+            p += 8;
+            any = true;
+        }
+        for (; p != end && isDigit(*p); ++p) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa)
+                    ++digits;
+                if (fraction)
+                    --exponent;
+            } else {
+                truncated |= *p != '0';
+                if (!fraction)
+                    ++exponent;
+            }
+        }
+    };
+
+    takeDigits(false);
+    if (p != end && *p == '.') {
+        ++p;
+        takeDigits(true);
+    }
+    if (!any)
+        return nullptr;
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool expNegative = false;
+        if (e != end && (*e == '-' || *e == '+')) {
+            expNegative = *e == '-';
+            ++e;
+        }
+        if (e != end && isDigit(*e)) {
+            int value = 0;
+            for (; e != end && isDigit(*e); ++e)
+                value = value < 10000 ? value * 10 + (*e - '0') : value;
+            exponent += expNegative ? -value : value;
+            p = e;
+        }
+    }
+
+    if (!truncated && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / kPow10[-exponent] : value * kPow10[exponent];
+        out = negative ? -value : value;
+        return p;
+    }
+    // Slow but exact and still locale independent; from_chars does not take '+'
+    const char* slowStart = (start != numberStart && *start == '+') ? numberStart : start;
+    auto [ptr, ec] = from_chars(slowStart, p, out);
+    if (ec == errc::result_out_of_range) {
+        // from_chars leaves out alone here; give what strtod would, +-inf or +-0
+        double magnitude = exponent + digits > 0 ? numeric_limits<double>::infinity() : 0.0;
+        out = negative ? -magnitude : magnitude;
+    } else if (ec != errc()) {
+        return nullptr;
+    }
+    return ptr;
+}
+
+// Whole string must be a number (surrounding spaces allowed)
+inline bool parseDecimal(const string& text, double& out) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p != end && *p == ' ')
+        ++p;
+    while (end != p && end[-1] == ' ')
+        --end;
+    return p != end && parseDecimal(p, end, out) == end;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+constexpr int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// "YYYY-MM-DD HH:MM:SS" (or just "YYYY-MM-DD") to seconds since 1970 of that
+// wall-clock time. The 14 digits are packed into two words and converted with
+// parseEightDigits; separators are checked with one compare per word.
+inline bool parseTimestamp(const char* p, size_t len, int64_t& out) {
+    if (len != 19 && len != 10)
+        return false;
+    char packed[16];
+    memcpy(packed, p, 4);          // YYYY
+    memcpy(packed + 4, p + 5, 2);  // MM
+    memcpy(packed + 6, p + 8, 2);  // DD
+    if (p[4] != '-' || p[7] != '-')
+        return false;
+    if (len == 19) {
+        if (p[10] != ' ' || p[13] != ':' || p[16] != ':')
+            return false;
+        memcpy(packed + 8, p + 11, 2);  // HH
+        memcpy(packed + 10, p + 14, 2); // MM
+        memcpy(packed + 12, p + 17, 2); // SS
+    } else {
+        memset(packed + 8, '0', 6);
+    }
+    packed[14] = packed[15] = '0';
+    uint64_t lo = load8(packed), hi = load8(packed + 8);
+    if (!isEightDigits(lo) || !isEightDigits(hi))
+        return false;
+    uint32_t ymd = parseEightDigits(lo);
+    uint32_t hms = parseEightDigits(hi) / 100;
+    unsigned year = ymd / 10000, month = ymd / 100 % 100, day = ymd % 100;
+    unsigned hour = hms / 10000, minute = hms / 100 % 100, second = hms % 100;
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+        return false;
+    out = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+inline bool parseTimestamp(const string& text, int64_t& out) { return parseTimestamp(text.data(), text.size(), out); }
+
+constexpr int64_t floorDiv(int64_t a, int64_t b) { return a / b - ((a % b != 0) && ((a < 0) != (b < 0))); }
+
+// Inverse of parseTimestamp, "YYYY-MM-DD HH:MM:SS"
+inline string formatTimestamp(int64_t t) {
+    int64_t days = floorDiv(t, 86400), secs = t - days * 86400;
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+    const int64_t y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%04lld-%02u-%02u %02lld:%02lld:%02lld", static_cast<long long>(y), m, d,
+             static_cast<long long>(secs / 3600), static_cast<long long>(secs / 60 % 60), static_cast<long long>(secs % 60));
+    return buf;
+}
+
+// Europe/Warsaw wall clock <-> UTC. GIOŚ dates are local time, samples are
+// kept as UTC seconds so ordering and dedup are plain integer compares.
+// Transitions follow the EU rule (last Sunday of March / October, 01:00 UTC)
+// and are precomputed at compile time, so a conversion is a table lookup and
+// two compares with no calendar math.
+class WarsawTime {
 public:
-    GraphPanel(wxWindow* parent, const vector<nlohmann::json>& data)
-        : wxPanel(parent), sensorData(data) {
-        Bind(wxEVT_PAINT, &GraphPanel::OnPaint, this);
+    static constexpr int kFirstYear = 1970;
+    static constexpr int kLastYear = 2100;
+
+    constexpr WarsawTime() {
+        for (int y = kFirstYear; y <= kLastYear; ++y) {
+            springUtc[y - kFirstYear] = lastSunday(y, 3, 31) * 86400 + 3600;
+            autumnUtc[y - kFirstYear] = lastSunday(y, 10, 31) * 86400 + 3600;
+        }
+    }
+
+    constexpr int64_t offset(int64_t utc) const {
+        size_t y = yearIndex(utc);
+        return (utc >= springUtc[y] && utc < autumnUtc[y]) ? 7200 : 3600;
+    }
+
+    constexpr int64_t utcToLocal(int64_t utc) const { return utc + offset(utc); }
+
+    // 02:00-02:59 on the last Sunday of October happens twice
+    constexpr bool isAmbiguous(int64_t local) const {
+        size_t y = yearIndex(local);
+        return local >= autumnUtc[y] + 3600 && local < autumnUtc[y] + 7200;
+    }
+
+    // later picks the second (winter time) occurrence of an ambiguous hour;
+    // the skipped hour in March is read as winter time
+    constexpr int64_t localToUtc(int64_t local, bool later = false) const {
+        size_t y = yearIndex(local);
+        bool summer = local >= springUtc[y] + 7200 && local < autumnUtc[y] + 3600;
+        if (!later && isAmbiguous(local))
+            summer = true;
+        return local - (summer ? 7200 : 3600);
+    }
+
+    void utcToLocal(const int64_t* in, int64_t* out, size_t n) const {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = utcToLocal(in[i]);
     }
 
 private:
-    vector<nlohmann::json> sensorData;
+    static constexpr size_t kYears = kLastYear - kFirstYear + 1;
+    array<int64_t, kYears> springUtc{};
+    array<int64_t, kYears> autumnUtc{};
 
-    void OnPaint(wxPaintEvent& event) {
-        wxPaintDC dc(this);
-        
-        thread t(&GraphPanel::DrawGraph, this, ref(dc));
-        t.join();
-        
-        //DrawGraph(dc);
+    static constexpr int64_t lastSunday(int y, unsigned m, unsigned lastDay) {
+        int64_t days = daysFromCivil(y, m, lastDay);
+        int64_t weekday = (days % 7 + 11) % 7; // 1970-01-01 was a Thursday, Sunday = 0
+        return days - weekday;
     }
 
-    // Updated DrawGraph function with grid lines
-    void DrawGraph(wxDC& dc) {
-        // Define margins for axis labels and grid boundaries
-        const int leftMargin = 60;
-        const int rightMargin = 50;
-        const int topMargin = 50;
-        const int bottomMargin = 200;
-        
-        int panelWidth = GetSize().GetWidth();
-        int panelHeight = GetSize().GetHeight();
-    
-        // Set dotted pen for grid lines
-        wxPen gridPen(wxColour(200, 200, 200), 1, wxPENSTYLE_DOT);
-        
-        // Draw horizontal grid lines (Y-axis grid remains evenly divided)
-        int horizontalDivisions = 10;
-        int gridStepY = (panelHeight - topMargin - bottomMargin) / horizontalDivisions;
-        for (int i = 0; i <= horizontalDivisions; ++i) {
-            int y = topMargin + i * gridStepY;
-            dc.SetPen(gridPen);
-            dc.DrawLine(leftMargin, y, panelWidth - rightMargin, y);
+    // Close enough: transitions are months away from new year, so being a
+    // day off around 1 January still compares the right way
+    static constexpr size_t yearIndex(int64_t t) {
+        int64_t y = floorDiv(t, 31556952);
+        return static_cast<size_t>(y < 0 ? 0 : (y >= static_cast<int64_t>(kYears) ? kYears - 1 : y));
+    }
+};
+
+constexpr WarsawTime warsawTime;
+static_assert(warsawTime.localToUtc(daysFromCivil(2024, 7, 1) * 86400) == daysFromCivil(2024, 7, 1) * 86400 - 7200, "CEST");
+static_assert(warsawTime.isAmbiguous(daysFromCivil(2024, 10, 27) * 86400 + 2 * 3600 + 1800), "autumn hour");
+
+// UTC time of one stored sample: the "t" we keep next to the GIOŚ date, or the
+// date itself when the entry is older than that
+inline bool entryUtc(const nlohmann::json& entry, int64_t& t) {
+    if (entry.contains("t") && entry["t"].is_number_integer()) {
+        t = entry["t"].get<int64_t>();
+        return true;
+    }
+    int64_t local;
+    if (!entry.contains("date") || !entry["date"].is_string() || !parseTimestamp(entry["date"].get_ref<const string&>(), local))
+        return false;
+    t = warsawTime.localToUtc(local);
+    return true;
+}
+
+// UTC times for a value array as GIOŚ sends it (newest first). When the same
+// local date shows up twice in the autumn hour, the older entry is summer
+// time and the newer one winter time. A lone autumn-hour entry is winter time
+// when isStored says the summer one is already stored (and the winter one
+// isn't): the batch then starts where an earlier fetch stopped. Unreadable
+// dates give INT64_MIN.
+inline vector<int64_t> batchTimesUtc(const nlohmann::json& values, const function<bool(int64_t)>& isStored = nullptr) {
+    vector<int64_t> utc(values.size(), numeric_limits<int64_t>::min());
+    vector<pair<int64_t, size_t>> order; // (local, index)
+    for (size_t i = 0; i < values.size(); ++i) {
+        const auto& entry = values[i];
+        int64_t local;
+        if (entry.contains("t") && entry["t"].is_number_integer())
+            utc[i] = entry["t"].get<int64_t>();
+        else if (entry.contains("date") && entry["date"].is_string() && parseTimestamp(entry["date"].get_ref<const string&>(), local))
+            order.push_back({local, i});
+    }
+    // Oldest first; equal local times keep "later in the array = older"
+    sort(order.begin(), order.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first < b.first : a.second > b.second;
+    });
+    int64_t previous = numeric_limits<int64_t>::min();
+    for (size_t k = 0; k < order.size(); ++k) {
+        int64_t local = order[k].first;
+        int64_t t = warsawTime.localToUtc(local);
+        if (warsawTime.isAmbiguous(local)) {
+            int64_t winter = warsawTime.localToUtc(local, true);
+            bool lone = (k == 0 || order[k - 1].first != local) && (k + 1 == order.size() || order[k + 1].first != local);
+            if (previous >= t || (lone && isStored && isStored(t) && !isStored(winter)))
+                t = winter;
         }
-    
-        // Set font for labels
-        dc.SetFont(wxFont(10, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
-    
-        // Extract sensor values and dates from the JSON data
-        vector<double> values;
-        vector<string> dates;
-        for (const auto& sensor : sensorData) {
-            for (const auto& dataEntry : sensor["values"]) {
-                // Only include the data if "value" exists and is not null
-                if (!dataEntry.contains("value") || dataEntry["value"].is_null())
-                    continue;
-                values.push_back(dataEntry["value"].get<double>());
-                dates.push_back(dataEntry["date"].get<string>());
-            }
+        utc[order[k].second] = previous = t;
+    }
+    return utc;
+}
+
+// Diurnal and weekly profiles: mean value per local hour of day and per
+// weekday, split by meteorological season (heating season vs summer tells
+// heating from traffic). One pass over the time/value columns: times go
+// through the DST table in a batch, the calendar month is only worked out
+// when the day changes.
+enum class Season : uint8_t { Winter, Spring, Summer, Autumn, Count };
+constexpr size_t kSeasonCount = static_cast<size_t>(Season::Count);
+constexpr array<string_view, kSeasonCount + 1> kSeasonNames = {"Winter", "Spring", "Summer", "Autumn", "Whole year"};
+constexpr array<string_view, 7> kWeekdayNames = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+
+constexpr unsigned monthOfDay(int64_t days) {
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    return mp < 10 ? mp + 3 : mp - 9;
+}
+
+constexpr Season seasonOfMonth(unsigned month) { return static_cast<Season>(month % 12 / 3); }
+
+static_assert(monthOfDay(daysFromCivil(2024, 2, 29)) == 2 && seasonOfMonth(12) == Season::Winter, "calendar");
+
+struct Profile {
+    // Index kSeasonCount is the whole year
+    array<array<double, 24>, kSeasonCount + 1> hourSum{};
+    array<array<uint32_t, 24>, kSeasonCount + 1> hourCount{};
+    array<array<double, 7>, kSeasonCount + 1> weekdaySum{};
+    array<array<uint32_t, 7>, kSeasonCount + 1> weekdayCount{};
+
+    double hourMean(size_t season, int hour) const {
+        return hourCount[season][hour] ? hourSum[season][hour] / hourCount[season][hour] : NAN;
+    }
+    double weekdayMean(size_t season, int weekday) const {
+        return weekdayCount[season][weekday] ? weekdaySum[season][weekday] / weekdayCount[season][weekday] : NAN;
+    }
+};
+
+// value NaN = missing
+inline Profile buildProfile(const int64_t* utc, const double* value, size_t n) {
+    Profile p;
+    vector<int64_t> local(n);
+    warsawTime.utcToLocal(utc, local.data(), n);
+    int64_t lastDay = numeric_limits<int64_t>::min();
+    size_t season = 0;
+    int weekday = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (isnan(value[i]))
+            continue;
+        int64_t day = floorDiv(local[i], 86400);
+        if (day != lastDay) {
+            lastDay = day;
+            season = static_cast<size_t>(seasonOfMonth(monthOfDay(day)));
+            weekday = static_cast<int>(((day + 3) % 7 + 7) % 7); // 1970-01-01 was a Thursday
         }
-        
-        // Reverse order so the earliest date is on the left
-        reverse(values.begin(), values.end());
-        reverse(dates.begin(), dates.end());
-        
-        if (values.empty())
+        int hour = static_cast<int>((local[i] - day * 86400) / 3600);
+        p.hourSum[season][hour] += value[i];
+        ++p.hourCount[season][hour];
+        p.weekdaySum[season][weekday] += value[i];
+        ++p.weekdayCount[season][weekday];
+    }
+    for (size_t s = 0; s < kSeasonCount; ++s) {
+        for (int h = 0; h < 24; ++h) {
+            p.hourSum[kSeasonCount][h] += p.hourSum[s][h];
+            p.hourCount[kSeasonCount][h] += p.hourCount[s][h];
+        }
+        for (int d = 0; d < 7; ++d) {
+            p.weekdaySum[kSeasonCount][d] += p.weekdaySum[s][d];
+            p.weekdayCount[kSeasonCount][d] += p.weekdayCount[s][d];
+        }
+    }
+    return p;
+}
+
+struct ProfileInput {
+    const int64_t* time;
+    const double* value;
+    size_t size;
+};
+
+// One profile per input (e.g. per station), spread over the cores
+inline vector<Profile> buildProfiles(const vector<ProfileInput>& inputs) {
+    vector<Profile> profiles(inputs.size());
+    size_t threads = min<size_t>(inputs.size(), max(1u, thread::hardware_concurrency()));
+    atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i; (i = next++) < inputs.size();)
+            profiles[i] = buildProfile(inputs[i].time, inputs[i].value, inputs[i].size);
+    };
+    vector<thread> pool;
+    for (size_t t = 1; t < threads; ++t)
+        pool.emplace_back(work);
+    work();
+    for (auto& t : pool)
+        t.join();
+    return profiles;
+}
+
+// Asynchronous structured logging. LOG_INFO("merged {} values into {}", n, file)
+// copies the format pointer and the binary arguments into a ring buffer that
+// belongs to the calling thread (single producer, single consumer, no locks)
+// and returns; a background thread formats and writes the lines. A full ring
+// drops the message instead of blocking; a thread's ring is freed once the
+// thread has exited and its lines are written. Levels below JPO_LOG_LEVEL
+// are removed at compile time. Format strings must be literals.
+enum LogLevel { LogDebug, LogInfo, LogWarn, LogError };
+
+#ifndef JPO_LOG_LEVEL
+#define JPO_LOG_LEVEL 1
+#endif
+
+class AsyncLogger {
+public:
+    ~AsyncLogger() { stop(); }
+
+    template <class... Args>
+    void log(LogLevel level, const char* format, const Args&... args) {
+        ThreadBuffer* buffer = local();
+        if (!buffer)
+            return;
+        size_t size = sizeof(Header) + (0 + ... + encodedSize(args));
+        size_t head = buffer->head.load(memory_order_relaxed);
+        if (size > ThreadBuffer::kSize - (head - buffer->tail.load(memory_order_acquire))) {
+            buffer->dropped.fetch_add(1, memory_order_relaxed);
             return;
-    
-        // Determine min and max for scaling
-        double maxValue = *max_element(values.begin(), values.end());
-        double minValue = *min_element(values.begin(), values.end());
-        double yRange = maxValue - minValue;
-        if (yRange == 0)
-            yRange = 1; // Avoid division by zero
-    
-        // Calculate scaling factors for the graph
-        double scaleX = (panelWidth - leftMargin - rightMargin) / static_cast<double>(values.size() - 1);
-        double scaleY = (panelHeight - topMargin - bottomMargin) / yRange;
-        
-        // Instead of using a fixed number of vertical divisions,
-        // determine an interval so that vertical grid lines align with date labels.
-        int verticalDivisions = 10;
-        size_t labelInterval = (values.size() / verticalDivisions) + 1;
-        
-        // Draw vertical grid lines at positions where date labels will appear
-        for (size_t i = 0; i < values.size(); i += labelInterval) {
-            double x = leftMargin + i * scaleX;
-            dc.SetPen(gridPen);
-            dc.DrawLine(x, topMargin, x, panelHeight - bottomMargin);
         }
-    
-        // Draw axes (on top of grid lines)
-        dc.SetPen(*wxBLACK_PEN);
-        dc.DrawLine(leftMargin, panelHeight - bottomMargin, panelWidth - rightMargin, panelHeight - bottomMargin); // X axis
-        dc.DrawLine(leftMargin, panelHeight - bottomMargin, leftMargin, topMargin); // Y axis
-    
-        // Draw data: connect points with lines
-        for (size_t i = 1; i < values.size(); ++i) {
-            double x1 = leftMargin + (i - 1) * scaleX;
-            double y1 = panelHeight - bottomMargin - (values[i - 1] - minValue) * scaleY;
-            double x2 = leftMargin + i * scaleX;
-            double y2 = panelHeight - bottomMargin - (values[i] - minValue) * scaleY;
-            dc.DrawLine(wxPoint(x1, y1), wxPoint(x2, y2));
+        Header header{static_cast<uint32_t>(size), static_cast<uint8_t>(level), static_cast<uint8_t>(sizeof...(args)), format,
+                      chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count()};
+        size_t pos = head;
+        buffer->put(pos, &header, sizeof(header));
+        (encode(*buffer, pos, args), ...);
+        buffer->head.store(head + size, memory_order_release);
+    }
+
+    // Final: threads that log after this are ignored and the writer is never
+    // started again
+    void stop() {
+        {
+            lock_guard<mutex> lock(buffersMutex);
+            bool wasRunning = state == State::Running;
+            state = State::Stopped;
+            if (!wasRunning)
+                return;
         }
-        
-        // Plot data points as circles
-        for (size_t i = 0; i < values.size(); ++i) {
-            double x = leftMargin + i * scaleX;
-            double y = panelHeight - bottomMargin - (values[i] - minValue) * scaleY;
-            dc.DrawCircle(wxPoint(x, y), 3);
+        running.store(false, memory_order_release);
+        writer.join();
+        drain(); // whatever came in while the writer was finishing
+    }
+
+private:
+    struct Header {
+        uint32_t size;
+        uint8_t level;
+        uint8_t argCount;
+        const char* format;
+        int64_t wallMs;
+    };
+
+    struct ThreadBuffer {
+        static constexpr size_t kSize = 1 << 16;
+        char data[kSize];
+        atomic<size_t> head{0}; // written by the owning thread
+        atomic<size_t> tail{0}; // written by the writer thread
+        atomic<uint64_t> dropped{0};
+        atomic<bool> retired{false}; // the owning thread has exited
+
+        void put(size_t& pos, const void* src, size_t n) {
+            const char* p = static_cast<const char*>(src);
+            for (size_t i = 0; i < n; ++i)
+                data[(pos + i) % kSize] = p[i];
+            pos += n;
         }
-    
-        // Draw Y-axis labels along horizontal grid lines
-        dc.SetFont(wxFont(8, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
-        for (int i = 0; i <= horizontalDivisions; ++i) {
-            int y = topMargin + i * gridStepY;
-            double valueLabel = maxValue - i * (yRange / horizontalDivisions);
-            wxString label;
-            label.Printf("%.2f", valueLabel);
-            dc.DrawText(label, 5, y - 7);
+        void get(size_t& pos, void* dst, size_t n) const {
+            char* p = static_cast<char*>(dst);
+            for (size_t i = 0; i < n; ++i)
+                p[i] = data[(pos + i) % kSize];
+            pos += n;
         }
-    
-        // Draw X-axis date labels aligned with the vertical grid lines,
-        // moved further down so they do not cover the graph.
-        for (size_t i = 0; i < values.size(); i += labelInterval) {
-            double x = leftMargin + i * scaleX;
-            wxString dateLabel = wxString::FromUTF8(dates[i].c_str());
-            dc.DrawRotatedText(dateLabel, x, panelHeight - bottomMargin + 125, 90);
+    };
+
+    enum class State { Idle, Running, Stopped };
+
+    // Marks the thread's buffer retired when the thread exits; the writer
+    // frees it once it is drained, so short-lived pool threads don't pile up
+    struct Owner {
+        ThreadBuffer* buffer = nullptr;
+        ~Owner() {
+            if (buffer)
+                buffer->retired.store(true, memory_order_release);
         }
-    
-        // Determine indices for the minimum and maximum values
-        auto minIt = min_element(values.begin(), values.end());
-        auto maxIt = max_element(values.begin(), values.end());
-        int minIndex = distance(values.begin(), minIt);
-        int maxIndex = distance(values.begin(), maxIt);
-    
-        // Highlight and label the minimum value point
+    };
+
+    mutex buffersMutex; // taken when a thread logs for the first time and by the writer
+    vector<unique_ptr<ThreadBuffer>> buffers;
+    thread writer;
+    atomic<bool> running{false};
+    State state = State::Idle; // guarded by buffersMutex
+
+    ThreadBuffer* local() {
+        thread_local Owner mine;
+        if (mine.buffer)
+            return mine.buffer;
+        lock_guard<mutex> lock(buffersMutex);
+        if (state == State::Stopped)
+            return nullptr;
+        buffers.push_back(make_unique<ThreadBuffer>());
+        mine.buffer = buffers.back().get();
+        if (state == State::Idle) {
+            state = State::Running;
+            running.store(true, memory_order_release);
+            writer = thread(&AsyncLogger::writeLoop, this);
+        }
+        return mine.buffer;
+    }
+
+    template <class T>
+    static size_t encodedSize(const T& value) {
+        if constexpr (is_arithmetic_v<T>)
+            return 1 + 8;
+        else
+            return 1 + 4 + string_view(value).size();
+    }
+
+    template <class T>
+    static void encode(ThreadBuffer& buffer, size_t& pos, const T& value) {
+        if constexpr (is_floating_point_v<T>) {
+            char tag = 'd';
+            double v = value;
+            buffer.put(pos, &tag, 1);
+            buffer.put(pos, &v, 8);
+        } else if constexpr (is_arithmetic_v<T>) {
+            char tag = is_signed_v<T> ? 'i' : 'u';
+            uint64_t v = static_cast<uint64_t>(value);
+            buffer.put(pos, &tag, 1);
+            buffer.put(pos, &v, 8);
+        } else {
+            char tag = 's';
+            string_view text(value);
+            uint32_t length = static_cast<uint32_t>(text.size());
+            buffer.put(pos, &tag, 1);
+            buffer.put(pos, &length, 4);
+            buffer.put(pos, text.data(), length);
+        }
+    }
+
+    void writeLoop() {
+        while (running.load(memory_order_acquire)) {
+            if (!drain())
+                this_thread::sleep_for(chrono::milliseconds(10));
+        }
+    }
+
+    // Formats everything that is queued; false when there was nothing
+    bool drain() {
+        static const char* const kLevelNames[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+        vector<ThreadBuffer*> snapshot, finished;
         {
-            double x = leftMargin + minIndex * scaleX;
-            double y = panelHeight - bottomMargin - (values[minIndex] - minValue) * scaleY;
-            wxPen highlightPen(*wxBLUE_PEN);
-            highlightPen.SetWidth(2);
-            dc.SetPen(highlightPen);
-            dc.DrawCircle(wxPoint(x, y), 5);
-            wxString minLabel;
-            minLabel.Printf("Min: %.2f (%s)", values[minIndex], wxString::FromUTF8(dates[minIndex].c_str()));
-            dc.DrawText(minLabel, x + 5, y - 10);
+            lock_guard<mutex> lock(buffersMutex);
+            for (auto& b : buffers)
+                snapshot.push_back(b.get());
         }
+        string out;
+        for (ThreadBuffer* buffer : snapshot) {
+            // Read before head: once retired is seen, head can't move any more
+            bool retired = buffer->retired.load(memory_order_acquire);
+            size_t tail = buffer->tail.load(memory_order_relaxed);
+            size_t head = buffer->head.load(memory_order_acquire);
+            while (tail != head) {
+                size_t pos = tail;
+                Header header;
+                buffer->get(pos, &header, sizeof(header));
+                int64_t seconds = floorDiv(header.wallMs, 1000);
+                out += formatTimestamp(warsawTime.utcToLocal(seconds));
+                char millis[8];
+                snprintf(millis, sizeof(millis), ".%03d ", static_cast<int>(header.wallMs - seconds * 1000));
+                out += millis;
+                out += kLevelNames[header.level];
+                out += ' ';
+                const char* f = header.format;
+                for (int arg = 0; arg < header.argCount; ++arg) {
+                    const char* hole = strstr(f, "{}");
+                    string text = decodeArg(*buffer, pos);
+                    if (!hole) {
+                        continue;
+                    }
+                    out.append(f, hole);
+                    out += text;
+                    f = hole + 2;
+                }
+                out += f;
+                out += '\n';
+                tail += header.size;
+            }
+            buffer->tail.store(tail, memory_order_release);
+            if (uint64_t lost = buffer->dropped.exchange(0, memory_order_relaxed))
+                out += "(logger dropped " + to_string(lost) + " messages)\n";
+            if (retired)
+                finished.push_back(buffer);
+        }
+        if (!finished.empty()) {
+            lock_guard<mutex> lock(buffersMutex);
+            buffers.erase(remove_if(buffers.begin(), buffers.end(),
+                                    [&](const unique_ptr<ThreadBuffer>& b) {
+                                        return find(finished.begin(), finished.end(), b.get()) != finished.end();
+                                    }),
+                          buffers.end());
+        }
+        if (!out.empty()) {
+            cerr << out;
+            cerr.flush();
+        }
+        return !out.empty();
+    }
+
+    static string decodeArg(const ThreadBuffer& buffer, size_t& pos) {
+        char tag;
+        buffer.get(pos, &tag, 1);
+        if (tag == 's') {
+            uint32_t length;
+            buffer.get(pos, &length, 4);
+            string text(length, '\0');
+            buffer.get(pos, text.data(), length);
+            return text;
+        }
+        uint64_t raw;
+        buffer.get(pos, &raw, 8);
+        if (tag == 'd') {
+            double v;
+            memcpy(&v, &raw, 8);
+            char text[32];
+            snprintf(text, sizeof(text), "%g", v);
+            return text;
+        }
+        return tag == 'i' ? to_string(static_cast<int64_t>(raw)) : to_string(raw);
+    }
+};
+
+AsyncLogger asyncLogger;
+
+#define LOG_AT(level, ...)                            \
+    do {                                              \
+        if constexpr ((level) >= JPO_LOG_LEVEL)       \
+            asyncLogger.log((level), __VA_ARGS__);    \
+    } while (0)
+#define LOG_DEBUG(...) LOG_AT(LogDebug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LogInfo, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LogWarn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LogError, __VA_ARGS__)
+
+inline int64_t monotonicNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Flight recorder: the last few hundred trace spans (updateData, parsing a
+// station file, DrawGraph, ...) in a fixed ring. Recording is a couple of
+// atomic stores, so it stays on all the time; the stall watchdog dumps it.
+class FlightRecorder {
+public:
+    static constexpr size_t kSize = 512;
+
+    uint64_t begin(const char* name) {
+        uint64_t seq = next.fetch_add(1, memory_order_relaxed);
+        Record& r = records[seq % kSize];
+        r.seq.store(0, memory_order_relaxed); // invalid while being rewritten
+        r.name.store(name, memory_order_relaxed);
+        r.start.store(monotonicNs(), memory_order_relaxed);
+        r.end.store(0, memory_order_relaxed);
+        r.thread.store(static_cast<uint32_t>(hash<thread::id>()(this_thread::get_id())), memory_order_relaxed);
+        r.seq.store(seq, memory_order_release);
+        return seq;
+    }
+
+    void end(uint64_t seq) {
+        Record& r = records[seq % kSize];
+        if (r.seq.load(memory_order_acquire) == seq)
+            r.end.store(monotonicNs(), memory_order_release);
+    }
+
+    // Instant event, shows up with zero duration
+    void event(const char* name) { end(begin(name)); }
+
+    // Everything that overlaps [from, now], oldest first; running spans are marked
+    void dump(ostream& out, int64_t from = 0) const {
+        int64_t now = monotonicNs();
+        uint64_t last = next.load(memory_order_acquire);
+        uint64_t first = last > kSize ? last - kSize : 1;
+        for (uint64_t seq = first; seq < last; ++seq) {
+            const Record& r = records[seq % kSize];
+            if (r.seq.load(memory_order_acquire) != seq)
+                continue;
+            int64_t start = r.start.load(memory_order_relaxed), end = r.end.load(memory_order_acquire);
+            if (end != 0 && end < from)
+                continue;
+            out << "  " << setw(10) << fixed << setprecision(1) << (start - now) / 1e6 << " ms  "
+                << left << setw(28) << r.name.load(memory_order_relaxed) << right;
+            if (end == 0)
+                out << " RUNNING for " << (now - start) / 1e6 << " ms";
+            else if (end != start)
+                out << " took " << (end - start) / 1e6 << " ms";
+            out << "  [thread " << hex << r.thread.load(memory_order_relaxed) << dec << "]\n";
+        }
+    }
+
+private:
+    struct Record {
+        atomic<uint64_t> seq{0};
+        atomic<const char*> name{""};
+        atomic<int64_t> start{0};
+        atomic<int64_t> end{0};
+        atomic<uint32_t> thread{0};
+    };
+    array<Record, kSize> records;
+    atomic<uint64_t> next{1};
+};
+
+FlightRecorder flightRecorder;
+
+// Records the enclosing scope in the flight recorder
+struct TraceSpan {
+    explicit TraceSpan(const char* name) : seq(flightRecorder.begin(name)) {}
+    ~TraceSpan() { flightRecorder.end(seq); }
+    uint64_t seq;
+};
+
+// Watches the GUI event loop from its own thread. The loop beats on every
+// idle event and on a 100 ms timer; when no beat arrives for longer than the
+// threshold, the flight recorder is dumped (to stderr and stall.log) while
+// the stall is still going on, so the span that holds the loop shows up as
+// RUNNING. When the loop comes back, the stall length is logged too.
+class StallWatchdog {
+public:
+    ~StallWatchdog() { stop(); }
+
+    void start(wxEvtHandler* loopOwner, int thresholdMs) {
+        threshold = thresholdMs * 1000000LL;
+        beat();
+        loopOwner->Bind(wxEVT_IDLE, [this](wxIdleEvent& event) {
+            beat();
+            event.Skip();
+        });
+        // Own timer id, so the owner's other wxEVT_TIMER handlers don't see these
+        heartbeatTimer.SetOwner(loopOwner, wxWindow::NewControlId());
+        loopOwner->Bind(wxEVT_TIMER, [this](wxTimerEvent&) { beat(); }, heartbeatTimer.GetId());
+        heartbeatTimer.Start(100);
+        running = true;
+        worker = thread(&StallWatchdog::watch, this);
+    }
+
+    void stop() {
+        if (!running.exchange(false))
+            return;
+        heartbeatTimer.Stop();
+        worker.join();
+    }
+
+    void beat() { lastBeat.store(monotonicNs(), memory_order_release); }
+
+private:
+    wxTimer heartbeatTimer;
+    thread worker;
+    atomic<bool> running{false};
+    atomic<int64_t> lastBeat{0};
+    int64_t threshold = 0;
+
+    void watch() {
+        bool stalled = false;
+        int64_t stallStart = 0;
+        while (running) {
+            this_thread::sleep_for(chrono::milliseconds(50));
+            int64_t beatAt = lastBeat.load(memory_order_acquire);
+            int64_t gap = monotonicNs() - beatAt;
+            if (!stalled && gap > threshold) {
+                stalled = true;
+                stallStart = beatAt;
+                report("event loop stalled for " + to_string(gap / 1000000) + " ms so far", stallStart);
+            } else if (stalled && beatAt != stallStart) {
+                stalled = false;
+                report("event loop stall over after " + to_string((beatAt - stallStart) / 1000000) + " ms", stallStart);
+            }
+        }
+    }
+
+    void report(const string& headline, int64_t from) {
+        ostringstream text;
+        text << "=== " << headline << " ===\n";
+        flightRecorder.dump(text, from);
+        cerr << text.str();
+        ofstream log("stall.log", ios::app);
+        if (log.is_open())
+            log << text.str();
+    }
+};
+
+StallWatchdog stallWatchdog;
+
+// Interaction latency marks (see UiBenchmark); the benchmark waits for these
+struct UiTrace {
+    function<void(const char*)> onMark;
+};
+UiTrace uiTrace;
+
+void uiMark(const char* name) {
+    if (uiTrace.onMark)
+        uiTrace.onMark(name);
+}
+
+// Least-squares slope over the sample index
+string calculateTrend(const vector<double>& values) {
+    if (values.size() < 2) {
+        return "Not enough data";
+    }
     
-        // Highlight and label the maximum value point
+    size_t n = values.size();
+    double sumX = 0;
+    double sumY = 0;
+    double sumXY = 0;
+    double sumX2 = 0;
+    
+    // Use index as the x-coordinate
+    for (size_t i = 0; i < n; ++i) {
+        double x = static_cast<double>(i);
+        double y = values[i];
+        sumX += x;
+        sumY += y;
+        sumXY += x * y;
+        sumX2 += x * x;
+    }
+    
+    // Calculate slope using the formula:
+    // slope = (n*sumXY - sumX*sumY) / (n*sumX2 - (sumX)^2)
+    double denominator = n * sumX2 - sumX * sumX;
+    if (denominator == 0) {
+        return "Undefined trend";
+    }
+    double slope = (n * sumXY - sumX * sumY) / denominator;
+    double slopdeg=0.1763;
+    if (slope > slopdeg) {
+        return "Rising";
+    } else if (slope < -slopdeg) {
+        return "Falling";
+    } else {
+        return "Stable";
+    }
+}
+
+// Column view of one sensor's history: UTC timestamps (oldest first), values and
+// a validity bitmap (bit i set = value i is present). Missing values are
+// stored as NaN so kernels can run over the whole column without branching.
+struct Series {
+    vector<int64_t> time;
+    vector<double> value;
+    vector<uint64_t> valid;
+
+    size_t size() const { return time.size(); }
+    bool isValid(size_t i) const { return (valid[i / 64] >> (i % 64)) & 1; }
+
+    void push(int64_t t, double v, bool ok) {
+        size_t i = time.size();
+        if (i % 64 == 0)
+            valid.push_back(0);
+        time.push_back(t);
+        value.push_back(ok ? v : NAN);
+        if (ok)
+            valid[i / 64] |= 1ULL << (i % 64);
+    }
+};
+
+// Builds the columns (UTC times) from a sensor entry of <stationID>.json.
+// Values come newest first and may repeat a time, the first present value wins.
+Series seriesFromJson(const nlohmann::json& sensor) {
+    vector<pair<int64_t, double>> rows;
+    if (sensor.contains("values")) {
+        const nlohmann::json& values = sensor["values"];
+        vector<int64_t> times = batchTimesUtc(values);
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (times[i] == numeric_limits<int64_t>::min())
+                continue;
+            const auto& entry = values[i];
+            bool missing = !entry.contains("value") || entry["value"].is_null();
+            rows.push_back({times[i], missing ? NAN : entry["value"].get<double>()});
+        }
+    }
+    stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    Series series;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (i > 0 && rows[i].first == rows[i - 1].first) {
+            size_t last = series.size() - 1;
+            if (!series.isValid(last) && !isnan(rows[i].second)) {
+                series.value[last] = rows[i].second;
+                series.valid[last / 64] |= 1ULL << (last % 64);
+            }
+            continue;
+        }
+        series.push(rows[i].first, rows[i].second, !isnan(rows[i].second));
+    }
+    return series;
+}
+
+// Joins any number of series onto one hourly UTC grid. Each source is
+// walked once alongside the grid and a grid point takes the present sample
+// with exactly that timestamp. The result only holds row numbers into the
+// sources, nothing is copied.
+struct JoinSpec {
+    bool intersect = false; // grid only over the range every series covers
+};
+
+class AlignedView {
+public:
+    vector<int64_t> grid;
+    vector<const Series*> sources;
+    vector<vector<int32_t>> rows; // rows[k][i] = row of source k for grid[i], -1 = none
+
+    size_t size() const { return grid.size(); }
+    bool has(size_t k, size_t i) const { return rows[k][i] >= 0; }
+    double value(size_t k, size_t i) const { return has(k, i) ? sources[k]->value[rows[k][i]] : NAN; }
+
+    // Copies one column out, only for callers that really need a Series
+    Series column(size_t k) const {
+        Series out;
+        for (size_t i = 0; i < size(); ++i)
+            out.push(grid[i], value(k, i), has(k, i));
+        return out;
+    }
+};
+
+AlignedView alignOnGrid(const vector<const Series*>& inputs, const JoinSpec& spec) {
+    AlignedView view;
+    view.sources = inputs;
+    view.rows.resize(inputs.size());
+    int64_t first = numeric_limits<int64_t>::max(), last = numeric_limits<int64_t>::min();
+    if (spec.intersect)
+        swap(first, last);
+    for (const Series* s : inputs) {
+        if (s->size() == 0) {
+            if (spec.intersect)
+                return view;
+            continue;
+        }
+        first = spec.intersect ? max(first, s->time.front()) : min(first, s->time.front());
+        last = spec.intersect ? min(last, s->time.back()) : max(last, s->time.back());
+    }
+    if (inputs.empty() || first > last)
+        return view;
+    for (int64_t t = floorDiv(first, 3600) * 3600; t <= last; t += 3600)
+        view.grid.push_back(t);
+
+    for (size_t k = 0; k < inputs.size(); ++k) {
+        const Series& s = *inputs[k];
+        vector<int32_t>& rows = view.rows[k];
+        rows.assign(view.grid.size(), -1);
+        size_t j = 0;
+        for (size_t i = 0; i < view.grid.size(); ++i) {
+            int64_t t = view.grid[i];
+            while (j < s.size() && s.time[j] < t)
+                ++j;
+            if (j < s.size() && s.time[j] == t && s.isValid(j))
+                rows[i] = static_cast<int32_t>(j);
+        }
+    }
+    return view;
+}
+
+// Fixed-width histogram of the non-NaN values: a min/max pass, then one
+// multiply per value to find its bin
+struct Histogram {
+    double lo = 0;
+    double width = 1;
+    vector<uint32_t> counts;
+};
+
+inline Histogram buildHistogram(const double* value, size_t n, size_t bins) {
+    Histogram h;
+    h.counts.assign(bins, 0);
+    double lo = numeric_limits<double>::max(), hi = numeric_limits<double>::lowest();
+    for (size_t i = 0; i < n; ++i) {
+        if (isnan(value[i]))
+            continue;
+        lo = min(lo, value[i]);
+        hi = max(hi, value[i]);
+    }
+    if (lo > hi || bins == 0)
+        return h;
+    h.lo = lo;
+    h.width = hi > lo ? (hi - lo) / bins : 1;
+    double scale = 1 / h.width;
+    for (size_t i = 0; i < n; ++i) {
+        if (isnan(value[i]))
+            continue;
+        size_t bin = static_cast<size_t>((value[i] - lo) * scale);
+        ++h.counts[min(bin, bins - 1)];
+    }
+    return h;
+}
+
+// Number of (x, y) points falling on each pixel of a width x height grid
+// spanning the given ranges, row 0 at the top (highest y). A scatter is
+// drawn from this as one image instead of a circle per point.
+inline vector<uint32_t> densityGrid(const double* x, const double* y, size_t n, double xlo, double xhi, double ylo, double yhi,
+                                    int width, int height) {
+    vector<uint32_t> grid(static_cast<size_t>(width) * height, 0);
+    double sx = xhi > xlo ? width / (xhi - xlo) : 0, sy = yhi > ylo ? height / (yhi - ylo) : 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (isnan(x[i]) || isnan(y[i]))
+            continue;
+        int px = min(width - 1, max(0, static_cast<int>((x[i] - xlo) * sx)));
+        int py = min(height - 1, max(0, static_cast<int>((yhi - y[i]) * sy)));
+        ++grid[static_cast<size_t>(py) * width + px];
+    }
+    return grid;
+}
+
+class GraphPanel : public wxPanel {
+public:
+    GraphPanel(wxWindow* parent, const vector<nlohmann::json>& data)
+        : wxPanel(parent), sensorData(data) {
+        for (const auto& sensor : sensorData) {
+            if (sensor.contains("param"))
+                param = paramFromCode(sensor["param"].value("paramCode", ""));
+        }
+        Bind(wxEVT_PAINT, &GraphPanel::OnPaint, this);
+    }
+
+    enum ChartType { TimeLine, DailyProfile, WeeklyProfile, ValueHistogram, ScatterDensity };
+
+    void SetChart(ChartType type) {
+        chart = type;
+        Refresh();
+    }
+
+    // Draws into any DC, used by the render benchmark
+    void Render(wxDC& dc) { DrawGraph(dc); }
+
+private:
+    vector<nlohmann::json> sensorData;
+    Param param = Param::Count;
+    ChartType chart = TimeLine;
+
+    void OnPaint(wxPaintEvent& event) {
+        wxPaintDC dc(this);
+        // wx drawing objects (DCs, images, bitmaps) belong to the GUI thread
+        DrawGraph(dc);
+        uiMark("graph");
+    }
+
+    // UTC times and values (NaN when missing) of one sensor entry
+    static void ColumnsOf(const nlohmann::json& sensor, vector<int64_t>& times, vector<double>& values) {
+        times.clear();
+        values.clear();
+        if (!sensor.contains("values"))
+            return;
+        const nlohmann::json& entries = sensor["values"];
+        times = batchTimesUtc(entries);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            bool ok = times[i] != numeric_limits<int64_t>::min() && entries[i].contains("value") && entries[i]["value"].is_number();
+            values.push_back(ok ? entries[i]["value"].get<double>() : NAN);
+        }
+    }
+
+    static string CodeOf(const nlohmann::json& sensor) {
+        return sensor.contains("param") ? sensor["param"].value("paramCode", "") : "";
+    }
+
+    void DrawHistogram(wxDC& dc) {
+        TraceSpan span("DrawHistogram");
+        const int leftMargin = 60, rightMargin = 50, topMargin = 50, bottomMargin = 80;
+        int panelWidth = GetSize().GetWidth();
+        int panelHeight = GetSize().GetHeight();
+        if (sensorData.empty())
+            return;
+        vector<int64_t> times;
+        vector<double> values;
+        ColumnsOf(sensorData.front(), times, values);
+        // Only the first sensor is drawn, its parameter picks the colours
+        Param shown = paramFromCode(CodeOf(sensorData.front()));
+        const size_t bins = 40;
+        Histogram h = buildHistogram(values.data(), values.size(), bins);
+        uint32_t most = h.counts.empty() ? 0 : *max_element(h.counts.begin(), h.counts.end());
+        if (most == 0) {
+            dc.DrawText("No data", leftMargin, topMargin);
+            return;
+        }
+        double barWidth = (panelWidth - leftMargin - rightMargin) / static_cast<double>(bins);
+        double scaleY = (panelHeight - topMargin - bottomMargin) / static_cast<double>(most);
+        int baseY = panelHeight - bottomMargin;
+        dc.SetFont(wxFont(8, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+        for (size_t b = 0; b < bins; ++b) {
+            double lo = h.lo + b * h.width;
+            size_t level = aqiLevel(shown, lo + h.width / 2);
+            static const wxColour kAqiColours[] = {wxColour(87, 177, 8), wxColour(176, 221, 16), wxColour(255, 217, 17),
+                                                   wxColour(229, 129, 0), wxColour(229, 0, 0), wxColour(153, 0, 0)};
+            wxColour colour = level < kAqiLevels.size() ? kAqiColours[level] : wxColour(70, 110, 180);
+            int x = leftMargin + static_cast<int>(b * barWidth);
+            int height = static_cast<int>(h.counts[b] * scaleY);
+            dc.SetPen(*wxBLACK_PEN);
+            dc.SetBrush(wxBrush(colour));
+            dc.DrawRectangle(x, baseY - height, max(1, static_cast<int>(barWidth) - 1), height);
+            if (b % 5 == 0)
+                dc.DrawText(wxString::Format("%.1f", lo), x, baseY + 5);
+        }
+        for (int i = 0; i <= 5; ++i)
+            dc.DrawText(wxString::Format("%u", static_cast<unsigned>(most * i / 5)), 5, baseY - static_cast<int>(most * i / 5 * scaleY) - 7);
+        dc.SetPen(*wxBLACK_PEN);
+        dc.DrawLine(leftMargin, baseY, panelWidth - rightMargin, baseY);
+        dc.SetFont(wxFont(10, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_BOLD));
+        dc.DrawText(wxString::Format("Distribution of %s values (bin width %.2f)", CodeOf(sensorData.front()), h.width), leftMargin, panelHeight - 40);
+    }
+
+    // First sensor on x, second on y, joined on the hourly grid; drawn as a
+    // density image, darker pixels hold more points
+    void DrawScatter(wxDC& dc) {
+        TraceSpan span("DrawScatter");
+        const int leftMargin = 60, rightMargin = 50, topMargin = 50, bottomMargin = 80;
+        int panelWidth = GetSize().GetWidth();
+        int panelHeight = GetSize().GetHeight();
+        if (sensorData.size() < 2) {
+            dc.DrawText("The scatter needs two sensors (use Compare Parameters in the station window)", leftMargin, topMargin);
+            return;
+        }
+        Series seriesX = seriesFromJson(sensorData[0]), seriesY = seriesFromJson(sensorData[1]);
+        JoinSpec overlap;
+        overlap.intersect = true;
+        AlignedView view = alignOnGrid({&seriesX, &seriesY}, overlap);
+        vector<double> xs, ys;
+        for (size_t i = 0; i < view.size(); ++i) {
+            if (view.has(0, i) && view.has(1, i)) {
+                xs.push_back(view.value(0, i));
+                ys.push_back(view.value(1, i));
+            }
+        }
+        if (xs.empty()) {
+            dc.DrawText("No common hours", leftMargin, topMargin);
+            return;
+        }
+        auto [xlo, xhi] = minmax_element(xs.begin(), xs.end());
+        auto [ylo, yhi] = minmax_element(ys.begin(), ys.end());
+        int width = max(1, panelWidth - leftMargin - rightMargin), height = max(1, panelHeight - topMargin - bottomMargin);
+        vector<uint32_t> grid = densityGrid(xs.data(), ys.data(), xs.size(), *xlo, *xhi, *ylo, *yhi, width, height);
+        uint32_t most = *max_element(grid.begin(), grid.end());
+        wxImage image(width, height);
+        unsigned char* rgb = image.GetData();
+        double norm = 1 / log1p(static_cast<double>(most));
+        for (size_t i = 0; i < grid.size(); ++i) {
+            double f = grid[i] ? 0.25 + 0.75 * log1p(static_cast<double>(grid[i])) * norm : 0;
+            rgb[3 * i] = static_cast<unsigned char>(255 * (1 - f));
+            rgb[3 * i + 1] = static_cast<unsigned char>(255 * (1 - 0.8 * f));
+            rgb[3 * i + 2] = static_cast<unsigned char>(255 * (1 - 0.4 * f));
+        }
+        dc.DrawBitmap(wxBitmap(image), leftMargin, topMargin);
+
+        dc.SetPen(*wxBLACK_PEN);
+        dc.DrawLine(leftMargin, topMargin + height, leftMargin + width, topMargin + height);
+        dc.DrawLine(leftMargin, topMargin + height, leftMargin, topMargin);
+        dc.SetFont(wxFont(8, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+        for (int i = 0; i <= 5; ++i) {
+            dc.DrawText(wxString::Format("%.1f", *xlo + (*xhi - *xlo) * i / 5), leftMargin + width * i / 5 - 10, topMargin + height + 5);
+            dc.DrawText(wxString::Format("%.1f", *ylo + (*yhi - *ylo) * i / 5), 5, topMargin + height - height * i / 5 - 7);
+        }
+        // Pearson correlation, the quick consistency number
+        double mx = accumulate(xs.begin(), xs.end(), 0.0) / xs.size(), my = accumulate(ys.begin(), ys.end(), 0.0) / ys.size();
+        double sxy = 0, sxx = 0, syy = 0;
+        for (size_t i = 0; i < xs.size(); ++i) {
+            sxy += (xs[i] - mx) * (ys[i] - my);
+            sxx += (xs[i] - mx) * (xs[i] - mx);
+            syy += (ys[i] - my) * (ys[i] - my);
+        }
+        double r = sxx > 0 && syy > 0 ? sxy / sqrt(sxx * syy) : NAN;
+        dc.SetFont(wxFont(10, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_BOLD));
+        dc.DrawText(wxString::Format("%s (x) vs %s (y): %zu hours, r = %.3f", CodeOf(sensorData[0]), CodeOf(sensorData[1]), xs.size(), r),
+                    leftMargin, panelHeight - 40);
+    }
+
+    // Mean per hour of day (or weekday): one line per season for a single
+    // sensor, the whole-year line of each sensor when there are several
+    void DrawProfile(wxDC& dc) {
+        TraceSpan span("DrawProfile");
+        const int leftMargin = 60, rightMargin = 50, topMargin = 50, bottomMargin = 80;
+        int panelWidth = GetSize().GetWidth();
+        int panelHeight = GetSize().GetHeight();
+        bool daily = chart == DailyProfile;
+        int buckets = daily ? 24 : 7;
+
+        vector<vector<int64_t>> times;
+        vector<vector<double>> values;
+        for (const auto& sensor : sensorData) {
+            if (!sensor.contains("values"))
+                continue;
+            times.emplace_back();
+            values.emplace_back();
+            ColumnsOf(sensor, times.back(), values.back());
+        }
+        vector<ProfileInput> inputs;
+        for (size_t i = 0; i < times.size(); ++i)
+            inputs.push_back({times[i].data(), values[i].data(), times[i].size()});
+        vector<Profile> profiles = buildProfiles(inputs);
+
+        // (label, colour, means) per line
+        vector<tuple<string, wxColour, vector<double>>> lines;
+        auto meansOf = [&](const Profile& p, size_t season) {
+            vector<double> means;
+            for (int b = 0; b < buckets; ++b)
+                means.push_back(daily ? p.hourMean(season, b) : p.weekdayMean(season, b));
+            return means;
+        };
+        static const wxColour kSeasonColours[] = {wxColour(40, 90, 200), wxColour(60, 160, 60), wxColour(230, 140, 0), wxColour(150, 80, 30), *wxBLACK};
+        if (profiles.size() == 1) {
+            for (size_t s = 0; s <= kSeasonCount; ++s)
+                lines.emplace_back(string(kSeasonNames[s]), kSeasonColours[s], meansOf(profiles[0], s));
+        } else {
+            for (size_t i = 0; i < profiles.size(); ++i)
+                lines.emplace_back("Sensor " + to_string(i + 1), kSeasonColours[i % 5], meansOf(profiles[i], kSeasonCount));
+        }
+
+        double maxValue = 0;
+        for (const auto& line : lines)
+            for (double v : get<2>(line))
+                if (!isnan(v))
+                    maxValue = max(maxValue, v);
+        if (maxValue == 0) {
+            dc.DrawText("No data", leftMargin, topMargin);
+            return;
+        }
+        double scaleX = (panelWidth - leftMargin - rightMargin) / static_cast<double>(buckets - 1);
+        double scaleY = (panelHeight - topMargin - bottomMargin) / maxValue;
+        int baseY = panelHeight - bottomMargin;
+
+        dc.SetFont(wxFont(8, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+        wxPen gridPen(wxColour(200, 200, 200), 1, wxPENSTYLE_DOT);
+        for (int i = 0; i <= 10; ++i) {
+            int y = baseY - static_cast<int>(i * maxValue / 10 * scaleY);
+            dc.SetPen(gridPen);
+            dc.DrawLine(leftMargin, y, panelWidth - rightMargin, y);
+            dc.DrawText(wxString::Format("%.1f", i * maxValue / 10), 5, y - 7);
+        }
+        dc.SetPen(*wxBLACK_PEN);
+        dc.DrawLine(leftMargin, baseY, panelWidth - rightMargin, baseY);
+        dc.DrawLine(leftMargin, baseY, leftMargin, topMargin);
+        for (int b = 0; b < buckets; b += daily ? 2 : 1) {
+            int x = leftMargin + static_cast<int>(b * scaleX);
+            dc.DrawText(daily ? wxString::Format("%02d:00", b) : wxString::FromUTF8(string(kWeekdayNames[b])), x - 12, baseY + 5);
+        }
+
+        int legendX = leftMargin;
+        for (const auto& [label, colour, means] : lines) {
+            dc.SetPen(wxPen(colour, label == "Whole year" ? 3 : 2));
+            for (int b = 1; b < buckets; ++b) {
+                if (isnan(means[b - 1]) || isnan(means[b]))
+                    continue;
+                dc.DrawLine(leftMargin + static_cast<int>((b - 1) * scaleX), baseY - static_cast<int>(means[b - 1] * scaleY),
+                            leftMargin + static_cast<int>(b * scaleX), baseY - static_cast<int>(means[b] * scaleY));
+            }
+            dc.DrawLine(legendX, topMargin - 20, legendX + 20, topMargin - 20);
+            dc.DrawText(wxString::FromUTF8(label), legendX + 25, topMargin - 27);
+            legendX += 120;
+        }
+        dc.SetPen(*wxBLACK_PEN);
+        dc.SetFont(wxFont(10, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_BOLD));
+        dc.DrawText(daily ? "Average by hour of day (local time)" : "Average by day of week", leftMargin, panelHeight - 40);
+    }
+
+    // Updated DrawGraph function with grid lines
+    void DrawGraph(wxDC& dc) {
+        if (chart == ValueHistogram) {
+            DrawHistogram(dc);
+            return;
+        }
+        if (chart == ScatterDensity) {
+            DrawScatter(dc);
+            return;
+        }
+        if (chart != TimeLine) {
+            DrawProfile(dc);
+            return;
+        }
+        TraceSpan span("DrawGraph");
+        // Define margins for axis labels and grid boundaries
+        const int leftMargin = 60;
+        const int rightMargin = 50;
+        const int topMargin = 50;
+        const int bottomMargin = 200;
+        
+        int panelWidth = GetSize().GetWidth();
+        int panelHeight = GetSize().GetHeight();
+    
+        // Set dotted pen for grid lines
+        wxPen gridPen(wxColour(200, 200, 200), 1, wxPENSTYLE_DOT);
+        
+        // Draw horizontal grid lines (Y-axis grid remains evenly divided)
+        int horizontalDivisions = 10;
+        int gridStepY = (panelHeight - topMargin - bottomMargin) / horizontalDivisions;
+        for (int i = 0; i <= horizontalDivisions; ++i) {
+            int y = topMargin + i * gridStepY;
+            dc.SetPen(gridPen);
+            dc.DrawLine(leftMargin, y, panelWidth - rightMargin, y);
+        }
+    
+        // Set font for labels
+        dc.SetFont(wxFont(10, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+    
+        // Extract sensor values and dates from the JSON data
+        vector<double> values;
+        vector<string> dates;
+        vector<bool> outliers; // flagged by the spatial outlier check
+        for (const auto& sensor : sensorData) {
+            for (const auto& dataEntry : sensor["values"]) {
+                // Only include the data if "value" exists and is not null
+                if (!dataEntry.contains("value") || dataEntry["value"].is_null())
+                    continue;
+                values.push_back(dataEntry["value"].get<double>());
+                dates.push_back(dataEntry["date"].get<string>());
+                outliers.push_back(dataEntry.contains("outlier"));
+            }
+        }
+        
+        // Reverse order so the earliest date is on the left
+        reverse(values.begin(), values.end());
+        reverse(dates.begin(), dates.end());
+        reverse(outliers.begin(), outliers.end());
+        
+        if (values.empty())
+            return;
+    
+        // Determine min and max for scaling
+        double maxValue = *max_element(values.begin(), values.end());
+        double minValue = *min_element(values.begin(), values.end());
+        double yRange = maxValue - minValue;
+        if (yRange == 0)
+            yRange = 1; // Avoid division by zero
+    
+        // Calculate scaling factors for the graph
+        double scaleX = (panelWidth - leftMargin - rightMargin) / static_cast<double>(values.size() - 1);
+        double scaleY = (panelHeight - topMargin - bottomMargin) / yRange;
+        
+        // Instead of using a fixed number of vertical divisions,
+        // determine an interval so that vertical grid lines align with date labels.
+        int verticalDivisions = 10;
+        size_t labelInterval = (values.size() / verticalDivisions) + 1;
+        
+        // Draw vertical grid lines at positions where date labels will appear
+        for (size_t i = 0; i < values.size(); i += labelInterval) {
+            double x = leftMargin + i * scaleX;
+            dc.SetPen(gridPen);
+            dc.DrawLine(x, topMargin, x, panelHeight - bottomMargin);
+        }
+    
+        // Draw axes (on top of grid lines)
+        dc.SetPen(*wxBLACK_PEN);
+        dc.DrawLine(leftMargin, panelHeight - bottomMargin, panelWidth - rightMargin, panelHeight - bottomMargin); // X axis
+        dc.DrawLine(leftMargin, panelHeight - bottomMargin, leftMargin, topMargin); // Y axis
+    
+        // Draw data: connect points with lines
+        for (size_t i = 1; i < values.size(); ++i) {
+            double x1 = leftMargin + (i - 1) * scaleX;
+            double y1 = panelHeight - bottomMargin - (values[i - 1] - minValue) * scaleY;
+            double x2 = leftMargin + i * scaleX;
+            double y2 = panelHeight - bottomMargin - (values[i] - minValue) * scaleY;
+            dc.DrawLine(wxPoint(x1, y1), wxPoint(x2, y2));
+        }
+        
+        // Plot data points as circles
+        for (size_t i = 0; i < values.size(); ++i) {
+            double x = leftMargin + i * scaleX;
+            double y = panelHeight - bottomMargin - (values[i] - minValue) * scaleY;
+            dc.DrawCircle(wxPoint(x, y), 3);
+            if (outliers[i]) {
+                dc.SetPen(wxPen(wxColour(200, 0, 200), 2));
+                dc.DrawCircle(wxPoint(x, y), 7);
+                dc.SetPen(*wxBLACK_PEN);
+            }
+        }
+    
+        // Draw Y-axis labels along horizontal grid lines
+        dc.SetFont(wxFont(8, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+        for (int i = 0; i <= horizontalDivisions; ++i) {
+            int y = topMargin + i * gridStepY;
+            double valueLabel = maxValue - i * (yRange / horizontalDivisions);
+            wxString label;
+            label.Printf("%.2f", valueLabel);
+            dc.DrawText(label, 5, y - 7);
+        }
+    
+        // Draw X-axis date labels aligned with the vertical grid lines,
+        // moved further down so they do not cover the graph.
+        for (size_t i = 0; i < values.size(); i += labelInterval) {
+            double x = leftMargin + i * scaleX;
+            wxString dateLabel = wxString::FromUTF8(dates[i].c_str());
+            dc.DrawRotatedText(dateLabel, x, panelHeight - bottomMargin + 125, 90);
+        }
+    
+        // Determine indices for the minimum and maximum values
+        auto minIt = min_element(values.begin(), values.end());
+        auto maxIt = max_element(values.begin(), values.end());
+        int minIndex = distance(values.begin(), minIt);
+        int maxIndex = distance(values.begin(), maxIt);
+    
+        // Highlight and label the minimum value point
+        {
+            double x = leftMargin + minIndex * scaleX;
+            double y = panelHeight - bottomMargin - (values[minIndex] - minValue) * scaleY;
+            wxPen highlightPen(*wxBLUE_PEN);
+            highlightPen.SetWidth(2);
+            dc.SetPen(highlightPen);
+            dc.DrawCircle(wxPoint(x, y), 5);
+            wxString minLabel;
+            minLabel.Printf("Min: %.2f (%s)", values[minIndex], wxString::FromUTF8(dates[minIndex].c_str()));
+            dc.DrawText(minLabel, x + 5, y - 10);
+        }
+    
+        // Highlight and label the maximum value point
+        {
+            double x = leftMargin + maxIndex * scaleX;
+            double y = panelHeight - bottomMargin - (values[maxIndex] - minValue) * scaleY;
+            wxPen highlightPen(*wxRED_PEN);
+            highlightPen.SetWidth(2);
+            dc.SetPen(highlightPen);
+            dc.DrawCircle(wxPoint(x, y), 5);
+            wxString maxLabel;
+            maxLabel.Printf("Max: %.2f (%s)", values[maxIndex], wxString::FromUTF8(dates[maxIndex].c_str()));
+            dc.DrawText(maxLabel, x + 5, y - 10);
+        }
+    
+        // Calculate average
+        double sum = accumulate(values.begin(), values.end(), 0.0);
+        double avg = (values.empty() ? 0 : sum / values.size());
+
+        // Optionally, display the current (most recent) sensor value near the X-axis.
+        wxString currentValueStr;
+        wxString printMin;
+        wxString printMax;
+        wxString avgStr;
+        wxString printTrend;
+
+        currentValueStr.Printf("Current Value: %.2f", values.back());
+        printMin.Printf("Min: %.2f (%s)", values[minIndex], wxString::FromUTF8(dates[minIndex].c_str()));
+        printMax.Printf("Max: %.2f (%s)", values[maxIndex], wxString::FromUTF8(dates[maxIndex].c_str()));
+        avgStr.Printf("Average Value: %.2f", avg);
+        printTrend.Printf("Trend: %s", calculateTrend(values));
+        wxFont currentValueFont(10, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_BOLD);
+        dc.SetFont(currentValueFont);
+        dc.SetPen(*wxBLACK_PEN);
+        dc.DrawText(currentValueStr, leftMargin, panelHeight - 40);
+        dc.DrawText(printMin, leftMargin+175, panelHeight - 40);
+        dc.DrawText(printMax, leftMargin+425, panelHeight - 40);
+        dc.DrawText(avgStr, leftMargin, panelHeight - 20);
+        dc.DrawText(printTrend, leftMargin + 175, panelHeight - 20);
+        size_t level = aqiLevel(param, values.back());
+        if (level < kAqiLevels.size()) {
+            wxString printIndex;
+            printIndex.Printf("Air Quality Index: %s", string(kAqiLevels[level]));
+            dc.DrawText(printIndex, leftMargin + 425, panelHeight - 20);
+        }
+    }
+};
+
+
+// Calendar heatmap of one sensor: hour of day against date, or day of month
+// against month, one coloured cell per value (Polish AQI colours when the
+// parameter has them, a grey-to-red scale otherwise). Cells come from the
+// raw hourly values and the compactor's daily rollups; the picture is drawn
+// once into a bitmap and only redrawn when the size or layout changes.
+class HeatmapPanel : public wxPanel {
+public:
+    enum Layout { HourByDate, DayByMonth };
+
+    HeatmapPanel(wxWindow* parent, const nlohmann::json& sensor) : wxPanel(parent) {
+        if (sensor.contains("param"))
+            param = paramFromCode(sensor["param"].value("paramCode", ""));
+        map<int64_t, pair<double, int>> sums; // local day -> sum, count of raw values
+        if (sensor.contains("values")) {
+            const nlohmann::json& values = sensor["values"];
+            vector<int64_t> times = batchTimesUtc(values);
+            for (size_t i = 0; i < values.size(); ++i) {
+                if (times[i] == numeric_limits<int64_t>::min() || !values[i].contains("value") || !values[i]["value"].is_number())
+                    continue;
+                double value = values[i]["value"].get<double>();
+                int64_t local = warsawTime.utcToLocal(times[i]);
+                int64_t day = floorDiv(local, 86400);
+                auto [row, added] = hours.try_emplace(day);
+                if (added)
+                    row->second.fill(NAN);
+                row->second[(local - day * 86400) / 3600] = static_cast<float>(value);
+                sums[day].first += value;
+                sums[day].second += 1;
+            }
+        }
+        if (sensor.contains("daily"))
+            for (const auto& day : sensor["daily"])
+                if (day.contains("t") && day.contains("mean"))
+                    days[floorDiv(warsawTime.utcToLocal(day["t"].get<int64_t>()), 86400)] = day["mean"].get<float>();
+        for (const auto& [day, sum] : sums)
+            days[day] = static_cast<float>(sum.first / sum.second);
+        for (const auto& [day, mean] : days) {
+            lowest = min(lowest, mean);
+            highest = max(highest, mean);
+        }
+        SetBackgroundStyle(wxBG_STYLE_PAINT);
+        Bind(wxEVT_PAINT, &HeatmapPanel::OnPaint, this);
+        Bind(wxEVT_SIZE, [this](wxSizeEvent& event) {
+            Refresh();
+            event.Skip();
+        });
+    }
+
+    void SetLayout(Layout l) {
+        layout = l;
+        cache = wxBitmap();
+        Refresh();
+    }
+
+private:
+    Param param = Param::Count;
+    Layout layout = DayByMonth;
+    map<int64_t, array<float, 24>> hours; // local day -> value per hour of day
+    map<int64_t, float> days;             // local day -> mean
+    float lowest = numeric_limits<float>::max(), highest = numeric_limits<float>::lowest();
+    wxBitmap cache;
+
+    void OnPaint(wxPaintEvent&) {
+        wxPaintDC dc(this);
+        wxSize size = GetClientSize();
+        if (!cache.IsOk() || cache.GetWidth() != size.GetWidth() || cache.GetHeight() != size.GetHeight()) {
+            TraceSpan span("HeatmapPanel render");
+            cache = wxBitmap(max(size.GetWidth(), 1), max(size.GetHeight(), 1));
+            wxMemoryDC memory(cache);
+            memory.SetBackground(*wxWHITE_BRUSH);
+            memory.Clear();
+            if (layout == HourByDate)
+                DrawHourByDate(memory, size);
+            else
+                DrawDayByMonth(memory, size);
+            memory.SelectObject(wxNullBitmap);
+        }
+        dc.DrawBitmap(cache, 0, 0);
+    }
+
+    wxColour CellColour(float value) const {
+        static const wxColour kAqiColours[] = {wxColour(87, 177, 8), wxColour(176, 221, 16), wxColour(255, 217, 17),
+                                               wxColour(229, 129, 0), wxColour(229, 0, 0), wxColour(153, 0, 0)};
+        if (isnan(value))
+            return wxColour(235, 235, 235);
+        size_t level = aqiLevel(param, value);
+        if (level < kAqiLevels.size())
+            return kAqiColours[level];
+        double f = highest > lowest ? (value - lowest) / (highest - lowest) : 0;
+        return wxColour(static_cast<unsigned char>(200 + 55 * f), static_cast<unsigned char>(200 * (1 - f)), static_cast<unsigned char>(200 * (1 - f)));
+    }
+
+    void DrawCell(wxDC& dc, double x, double y, double w, double h, float value) const {
+        wxColour colour = CellColour(value);
+        dc.SetPen(wxPen(colour));
+        dc.SetBrush(wxBrush(colour));
+        dc.DrawRectangle(static_cast<int>(x), static_cast<int>(y), max(1, static_cast<int>(x + w) - static_cast<int>(x)),
+                         max(1, static_cast<int>(y + h) - static_cast<int>(y)));
+    }
+
+    // Columns are days, rows the 24 hours
+    void DrawHourByDate(wxDC& dc, const wxSize& size) const {
+        const int left = 40, top = 20, bottom = 40;
+        if (hours.empty()) {
+            dc.DrawText("No hourly data", left, top);
+            return;
+        }
+        int64_t first = hours.begin()->first, last = hours.rbegin()->first;
+        double cellW = (size.GetWidth() - left - 10) / static_cast<double>(last - first + 1);
+        double cellH = (size.GetHeight() - top - bottom) / 24.0;
+        dc.SetFont(wxFont(8, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+        for (int h = 0; h < 24; h += 6)
+            dc.DrawText(wxString::Format("%02d:00", h), 2, top + h * cellH);
+        for (int64_t day = first; day <= last; ++day) {
+            double x = left + (day - first) * cellW;
+            auto it = hours.find(day);
+            for (int h = 0; h < 24; ++h)
+                DrawCell(dc, x, top + h * cellH, cellW, cellH, it == hours.end() ? NAN : it->second[h]);
+            string date = formatTimestamp(day * 86400);
+            if (date.compare(8, 2, "01") == 0 || day == first) {
+                dc.SetPen(*wxBLACK_PEN);
+                dc.DrawLine(x, top + 24 * cellH, x, top + 24 * cellH + 5);
+                dc.DrawText(wxString::FromUTF8(date.substr(0, 7)), x + 2, top + 24 * cellH + 5);
+            }
+        }
+    }
+
+    // Rows are months, columns the days of the month
+    void DrawDayByMonth(wxDC& dc, const wxSize& size) const {
+        const int left = 60, top = 25, bottom = 10;
+        if (days.empty()) {
+            dc.DrawText("No data", left, top);
+            return;
+        }
+        auto monthOf = [](int64_t day) {
+            string date = formatTimestamp(day * 86400);
+            return stoi(date.substr(0, 4)) * 12 + stoi(date.substr(5, 2)) - 1;
+        };
+        int firstMonth = monthOf(days.begin()->first), lastMonth = monthOf(days.rbegin()->first);
+        int rows = lastMonth - firstMonth + 1;
+        double cellW = (size.GetWidth() - left - 10) / 31.0;
+        double cellH = min(24.0, (size.GetHeight() - top - bottom) / static_cast<double>(rows));
+        dc.SetFont(wxFont(8, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+        for (int d = 1; d <= 31; d += 5)
+            dc.DrawText(wxString::Format("%d", d), left + (d - 1) * cellW, 5);
+        bool labels = cellH >= 10;
+        for (int month = firstMonth; month <= lastMonth; ++month) {
+            double y = top + (month - firstMonth) * cellH;
+            int year = month / 12, m = month % 12 + 1;
+            int64_t start = daysFromCivil(year, m, 1);
+            int64_t next = m == 12 ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, m + 1, 1);
+            for (int64_t day = start; day < next; ++day) {
+                auto it = days.find(day);
+                DrawCell(dc, left + (day - start) * cellW, y, cellW, cellH, it == days.end() ? NAN : it->second);
+            }
+            if (labels || m == 1)
+                dc.DrawText(wxString::Format("%04d-%02d", year, m), 2, y);
+        }
+    }
+};
+
+// Background maintenance threads run at the lowest CPU priority and in the
+// idle I/O class, so they only get the disk when nothing else wants it
+// (Linux only, elsewhere they run at normal priority)
+inline void lowerThreadPriority() {
+#ifdef __linux__
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    setpriority(PRIO_PROCESS, static_cast<id_t>(tid), 19);
+    const int ioprioWhoProcess = 1, ioprioClassIdle = 3, ioprioClassShift = 13;
+    syscall(SYS_ioprio_set, ioprioWhoProcess, tid, ioprioClassIdle << ioprioClassShift);
+#endif
+}
+
+// CRC32C (Castagnoli) of a byte range; SSE4.2 crc32 instructions when the
+// CPU has them, a table otherwise
+constexpr array<uint32_t, 256> kCrc32cTable = [] {
+    array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78u : 0);
+        table[i] = crc;
+    }
+    return table;
+}();
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) inline uint32_t crc32cHardware(const char* p, size_t size, uint32_t crc) {
+    uint64_t crc64 = crc;
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; ++p, --size)
+        crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*p));
+    return crc;
+}
+#endif
+
+inline uint32_t crc32c(const char* p, size_t size) {
+    uint32_t crc = ~0u;
+#if defined(__x86_64__)
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware)
+        return ~crc32cHardware(p, size, crc);
+#endif
+    for (; size > 0; ++p, --size)
+        crc = kCrc32cTable[(crc ^ static_cast<uint8_t>(*p)) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Serializes read-modify-write of one stored file between the UI thread and
+// the background threads. Plain readers don't take it, they get whole
+// versions anyway; StoredFiles takes it around writes and when it seals or
+// quarantines a file, also for callers that already hold it (recursive).
+recursive_mutex& storedFileMutex(const string& filename) {
+    static mutex mapMutex;
+    static unordered_map<string, unique_ptr<recursive_mutex>> mutexes;
+    lock_guard<mutex> lock(mapMutex);
+    unique_ptr<recursive_mutex>& m = mutexes[filename];
+    if (!m)
+        m = make_unique<recursive_mutex>();
+    return *m;
+}
+
+// Station files, findAllmine.json and database.json go through here. A write
+// goes to a temp file that is renamed over the old one, so a crash leaves
+// either version, and "<file>.crc" keeps the CRC32C and size of the current
+// and the previous content (the sidecar is renamed first, the data second).
+// A file is verified the first time it is read in this process, and again
+// only when its size or mtime changes; the background scan checks the rest
+// at idle priority. A corrupt file is moved to "<file>.corrupt" and reads as
+// missing, so it gets downloaded again instead of failing to parse forever.
+class StoredFiles {
+public:
+    ~StoredFiles() { stop(); }
+
+    // false when the file is missing or corrupt
+    bool read(const string& filename, string& content) {
+        Stamp st;
+        if (!stampOf(filename, st) || !readAll(filename, content))
+            return false;
+        if (isVerified(filename, st))
+            return true;
+        switch (check(filename, content)) {
+        case Ok:
+            markVerified(filename, st);
+            return true;
+        case Unsealed: { // written before checksums existed
+            // Seal what is on disk now, a write may have sealed it meanwhile
+            lock_guard<recursive_mutex> lock(storedFileMutex(filename));
+            if (!stampOf(filename, st) || !readAll(filename, content))
+                return false;
+            if (check(filename, content) == Unsealed) {
+                LOG_DEBUG("sealing {}", filename);
+                writeSidecar(filename, crc32c(content.data(), content.size()), content.size());
+            }
+            markVerified(filename, st);
+            return true;
+        }
+        case Corrupt:
+            break;
+        }
+        // The file can change under a concurrent write, look once more with writers held off
+        lock_guard<recursive_mutex> lock(storedFileMutex(filename));
+        if (readAll(filename, content) && check(filename, content) == Ok) {
+            if (stampOf(filename, st))
+                markVerified(filename, st);
+            return true;
+        }
+        LOG_ERROR("{} failed its CRC32C check, moved to {}.corrupt", filename, filename);
+        rename(filename.c_str(), (filename + ".corrupt").c_str());
+        rename((filename + ".crc").c_str(), (filename + ".corrupt.crc").c_str());
+        forget(filename);
+        return false;
+    }
+
+    bool write(const string& filename, const string& content) {
+        lock_guard<recursive_mutex> lock(storedFileMutex(filename));
+        string temp = filename + ".tmp";
+        {
+            ofstream out(temp, ios::binary | ios::trunc);
+            if (!out.is_open())
+                return false;
+            out.write(content.data(), content.size());
+            if (!out)
+                return false;
+        }
+        writeSidecar(filename, crc32c(content.data(), content.size()), content.size());
+        if (rename(temp.c_str(), filename.c_str()) != 0)
+            return false;
+        Stamp st;
+        if (stampOf(filename, st))
+            markVerified(filename, st);
+        return true;
+    }
+
+    // Verifies every sealed .json file in the working directory once
+    void startBackgroundScan() {
+        if (scanner.joinable())
+            return;
+        stopping = false;
+        scanner = thread([this] {
+            lowerThreadPriority();
+            vector<string> names;
+            error_code error;
+            for (const auto& entry : filesystem::directory_iterator(".", error)) {
+                string name = entry.path().filename().string();
+                if (name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0)
+                    names.push_back(name);
+            }
+            size_t corrupt = 0;
+            for (const auto& name : names) {
+                if (stopping)
+                    return;
+                Stamp st;
+                string content;
+                if (!stampOf(name, st) || isVerified(name, st) || !readAll(name, content))
+                    continue;
+                Check result = check(name, content);
+                if (result == Ok)
+                    markVerified(name, st);
+                else if (result == Corrupt && !(readAll(name, content) && check(name, content) == Ok)) {
+                    ++corrupt;
+                    LOG_ERROR("{} failed its CRC32C check, it will be downloaded again when opened", name);
+                }
+                this_thread::sleep_for(chrono::milliseconds(2));
+            }
+            LOG_INFO("Checksum scan: {} files, {} corrupt", names.size(), corrupt);
+        });
+    }
+
+    void stop() {
+        stopping = true;
+        if (scanner.joinable())
+            scanner.join();
+    }
+
+private:
+    enum Check { Ok, Unsealed, Corrupt };
+
+    // Size and mtime of a file, a change in either means it was written
+    struct Stamp {
+        uintmax_t size = 0;
+        filesystem::file_time_type mtime;
+    };
+
+    mutex verifiedMutex;
+    unordered_map<string, Stamp> verified;
+    thread scanner;
+    atomic<bool> stopping{false};
+
+    static bool stampOf(const string& filename, Stamp& st) {
+        error_code error;
+        st.size = filesystem::file_size(filename, error);
+        if (error)
+            return false;
+        st.mtime = filesystem::last_write_time(filename, error);
+        return !error;
+    }
+
+    bool isVerified(const string& filename, const Stamp& st) {
+        lock_guard<mutex> lock(verifiedMutex);
+        auto it = verified.find(filename);
+        return it != verified.end() && it->second.size == st.size && it->second.mtime == st.mtime;
+    }
+
+    void markVerified(const string& filename, const Stamp& st) {
+        lock_guard<mutex> lock(verifiedMutex);
+        verified[filename] = st;
+    }
+
+    void forget(const string& filename) {
+        lock_guard<mutex> lock(verifiedMutex);
+        verified.erase(filename);
+    }
+
+    static bool readAll(const string& filename, string& content) {
+        ifstream in(filename, ios::binary);
+        if (!in.is_open())
+            return false;
+        content.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        return true;
+    }
+
+    // Sidecar lines: "<crc hex> <size>", current content first
+    static Check check(const string& filename, const string& content) {
+        ifstream in(filename + ".crc");
+        if (!in.is_open())
+            return Unsealed;
+        uint32_t crc = crc32c(content.data(), content.size());
+        string line;
+        while (getline(in, line)) {
+            unsigned expected;
+            unsigned long long size;
+            if (sscanf(line.c_str(), "%x %llu", &expected, &size) == 2 && expected == crc && size == content.size())
+                return Ok;
+        }
+        return Corrupt;
+    }
+
+    // Sidecar and data have to be replaced as a pair, callers hold the lock too
+    static void writeSidecar(const string& filename, uint32_t crc, size_t size) {
+        lock_guard<recursive_mutex> lock(storedFileMutex(filename));
+        string sidecar = filename + ".crc";
+        string previous;
+        ifstream old(sidecar);
+        getline(old, previous);
+        old.close();
+        char line[32];
+        snprintf(line, sizeof(line), "%08x %zu", crc, size);
+        {
+            ofstream out(sidecar + ".tmp", ios::trunc);
+            out << line << "\n";
+            if (!previous.empty() && previous != line)
+                out << previous << "\n";
+        }
+        rename((sidecar + ".tmp").c_str(), sidecar.c_str());
+    }
+};
+
+StoredFiles storedFiles;
+
+
+// Base of the GIOŚ REST API. JPO_API_BASE can point somewhere else, e.g. a
+// file:// copy of the responses (testapi/) for offline runs and --ui-bench
+string apiUrl(const string& path) {
+    static const string base = getenv("JPO_API_BASE") ? getenv("JPO_API_BASE") : "https://api.gios.gov.pl/pjp-api/rest";
+    return base + "/" + path;
+}
+
+// Set by --ui-bench: nobody is there to answer message boxes
+bool unattended = false;
+
+int messageBox(const wxString& message, const wxString& caption = "Message", int style = wxOK | wxCENTRE, wxWindow* parent = nullptr) {
+    if (unattended) {
+        LOG_INFO("[{}] {} -> no", caption.utf8_string(), message.utf8_string());
+        return wxNO;
+    }
+    return wxMessageBox(message, caption, style, parent);
+}
+
+size_t WriteCallback(void* contents, size_t size, size_t nmemb, string* output) {
+    size_t totalSize = size * nmemb;
+    output->append((char*)contents, totalSize);
+    return totalSize;
+}
+
+void fetchAndSaveData(const string& url, const string& filename) {
+    TraceSpan span("fetchAndSaveData");
+    CURL* curl;
+    CURLcode result;
+    string responseString;
+
+    // libcurl's global state is set up once in MyApp::OnInit
+    curl = curl_easy_init();
+
+    if (curl) {
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseString);
+
+        result = curl_easy_perform(curl);
+
+        if (result == CURLE_OK) {
+            try {
+                nlohmann::json jsonData = nlohmann::json::parse(responseString);
+                lock_guard<recursive_mutex> lock(storedFileMutex(filename));
+                if (!storedFiles.write(filename, jsonData.dump(4)))
+                    LOG_ERROR("Could not write {}", filename);
+            } catch (nlohmann::json::parse_error& e) {
+                LOG_ERROR("JSON parsing error in {}: {}", url, e.what());
+            }
+        }
+
+        curl_easy_cleanup(curl);
+    }
+}
+
+// One entry of database.json (a measuring station)
+struct Station {
+    int id = 0;
+    string cityName;
+    string provinceName;
+    Province province = Province::Count;
+    double lat = 0;
+    double lon = 0;
+    int cluster = -1; // pollution profile group from clusterStations, -1 = none
+};
+
+nlohmann::json stationToJson(const Station& st) {
+    nlohmann::json entry;
+    entry["id"] = st.id;
+    entry["provinceName"] = st.provinceName;
+    entry["cityName"] = st.cityName;
+    entry["gegrLat"] = st.lat;
+    entry["geogrLon"] = st.lon;
+    if (st.cluster >= 0)
+        entry["cluster"] = st.cluster;
+    return entry;
+}
+
+Station stationFromJson(const nlohmann::json& entry) {
+    Station st;
+    st.id = entry["id"].get<int>();
+    st.cityName = entry["cityName"].get<string>();
+    st.provinceName = entry.value("provinceName", "");
+    st.province = provinceFromName(st.provinceName);
+    st.lat = entry["gegrLat"].get<double>();
+    st.lon = entry["geogrLon"].get<double>();
+    st.cluster = entry.value("cluster", -1);
+    return st;
+}
+
+// Case-insensitive key for city names (handles polish letters too)
+string normalizeName(const string& name) {
+    return wxString::FromUTF8(name).Lower().utf8_string();
+}
+
+// Difference between two catalog snapshots, keyed by station id
+struct CatalogDiff {
+    enum { Moved = 1, Renamed = 2, Regrouped = 4 };
+    vector<Station> added;
+    vector<int> removed;
+    vector<pair<Station, int>> changed; // new version + Moved/Renamed/Regrouped flags
+
+    bool empty() const { return added.empty() && removed.empty() && changed.empty(); }
+};
+
+// In-memory station catalog with the indexes used by the search window.
+// Stations live in slots; the indexes are patched from a CatalogDiff so a
+// refresh only touches the stations that actually changed.
+class StationCatalog {
+public:
+    void clear() {
+        slots.clear();
+        slotById.clear();
+        freeSlots.clear();
+        nameIndex.clear();
+        grid.clear();
+        for (auto& bits : provinceBits)
+            bits.clear();
+    }
+
+    void load(const vector<Station>& list) {
+        clear();
+        for (const auto& st : list)
+            insert(st);
+    }
+
+    vector<Station> snapshot() const {
+        vector<Station> list;
+        for (const auto& slot : slots)
+            if (slot.used)
+                list.push_back(slot.st);
+        sort(list.begin(), list.end(), [](const Station& a, const Station& b) { return a.id < b.id; });
+        return list;
+    }
+
+    size_t size() const { return slotById.size(); }
+
+    const Station* byId(int id) const {
+        auto it = slotById.find(id);
+        return it == slotById.end() ? nullptr : &slots[it->second].st;
+    }
+
+    CatalogDiff diff(const vector<Station>& fresh) const {
+        CatalogDiff d;
+        unordered_map<int, bool> seen;
+        for (const auto& st : fresh) {
+            seen[st.id] = true;
+            const Station* old = byId(st.id);
+            if (!old) {
+                d.added.push_back(st);
+                continue;
+            }
+            int flags = 0;
+            if (fabs(old->lat - st.lat) > 1e-7 || fabs(old->lon - st.lon) > 1e-7)
+                flags |= CatalogDiff::Moved;
+            if (old->cityName != st.cityName || old->provinceName != st.provinceName)
+                flags |= CatalogDiff::Renamed;
+            if (old->cluster != st.cluster)
+                flags |= CatalogDiff::Regrouped;
+            if (flags)
+                d.changed.push_back({st, flags});
+        }
+        for (const auto& [id, slot] : slotById)
+            if (!seen.count(id))
+                d.removed.push_back(id);
+        return d;
+    }
+
+    void apply(const CatalogDiff& d) {
+        for (int id : d.removed)
+            erase(id);
+        for (const auto& [st, flags] : d.changed) {
+            auto it = slotById.find(st.id);
+            if (it == slotById.end()) {
+                insert(st);
+                continue;
+            }
+            size_t slot = it->second;
+            Station& cur = slots[slot].st;
+            if (flags & CatalogDiff::Renamed) {
+                unindexName(cur, slot);
+                unindexProvince(cur, slot);
+                cur.cityName = st.cityName;
+                cur.provinceName = st.provinceName;
+                cur.province = st.province;
+                indexName(cur, slot);
+                indexProvince(cur, slot);
+            }
+            if (flags & CatalogDiff::Moved) {
+                unindexGrid(cur, slot);
+                cur.lat = st.lat;
+                cur.lon = st.lon;
+                indexGrid(cur, slot);
+            }
+            if (flags & CatalogDiff::Regrouped)
+                cur.cluster = st.cluster;
+        }
+        for (const auto& st : d.added)
+            insert(st);
+    }
+
+    // exact == false returns every station whose city name starts with the text
+    vector<const Station*> findByName(const string& text, bool exact) const {
+        vector<const Station*> found;
+        string key = normalizeName(text);
+        for (auto it = nameIndex.lower_bound(key); it != nameIndex.end(); ++it) {
+            if (exact ? it->first != key : it->first.compare(0, key.size(), key) != 0)
+                break;
+            found.push_back(&slots[it->second].st);
+        }
+        return found;
+    }
+
+    vector<const Station*> inProvince(Province province) const {
+        vector<const Station*> found;
+        const vector<uint64_t>& bits = provinceBits[static_cast<size_t>(province)];
+        for (size_t w = 0; w < bits.size(); ++w) {
+            for (uint64_t word = bits[w]; word; word &= word - 1)
+                found.push_back(&slots[w * 64 + __builtin_ctzll(word)].st);
+        }
+        return found;
+    }
+
+    // Groups are few and rarely queried, a scan is enough
+    vector<const Station*> inCluster(int cluster) const {
+        vector<const Station*> found;
+        for (const auto& slot : slots)
+            if (slot.used && slot.st.cluster == cluster)
+                found.push_back(&slot.st);
+        sort(found.begin(), found.end(), [](const Station* a, const Station* b) { return a->cityName < b->cityName; });
+        return found;
+    }
+
+    // Not indexed, so no diff needed
+    void setCluster(int id, int cluster) {
+        auto it = slotById.find(id);
+        if (it != slotById.end())
+            slots[it->second].st.cluster = cluster;
+    }
+
+    // Closest station by great-circle distance, searching grid rings outwards
+    const Station* nearest(double lat, double lon, double* distanceKm = nullptr) const {
+        if (grid.empty() || !validCoordinates(lat, lon))
+            return nullptr;
+        int qy = cellOf(lat), qx = cellOf(lon);
+        double cosLat = minCosLat(lat);
+        const Station* best = nullptr;
+        double bestDist = numeric_limits<double>::max();
+        for (int r = firstRing(qy, qx), last = lastRing(qy, qx); r <= last; ++r) {
+            // Nothing in ring r can be closer than (r - 1) cells
+            if (best && ringMinKm(r, cosLat) > bestDist)
+                break;
+            forRing(qy, qx, r, [&](const vector<size_t>& cell) {
+                for (size_t slot : cell) {
+                    const Station& st = slots[slot].st;
+                    double d = haversineKm(lat, lon, st.lat, st.lon);
+                    if (d < bestDist) {
+                        bestDist = d;
+                        best = &st;
+                    }
+                }
+            });
+        }
+        if (distanceKm)
+            *distanceKm = bestDist;
+        return best;
+    }
+
+    // The k closest stations accepted by the filter, nearest first, with
+    // their distances in km; same ring search as nearest()
+    vector<pair<double, const Station*>> nearestK(double lat, double lon, size_t k, const function<bool(const Station&)>& accept) const {
+        vector<pair<double, const Station*>> best; // max-heap on distance
+        if (grid.empty() || k == 0 || !validCoordinates(lat, lon))
+            return best;
+        int qy = cellOf(lat), qx = cellOf(lon);
+        double cosLat = minCosLat(lat);
+        for (int r = firstRing(qy, qx), last = lastRing(qy, qx); r <= last; ++r) {
+            if (best.size() == k && ringMinKm(r, cosLat) > best.front().first)
+                break;
+            forRing(qy, qx, r, [&](const vector<size_t>& cell) {
+                for (size_t slot : cell) {
+                    const Station& st = slots[slot].st;
+                    if (!accept(st))
+                        continue;
+                    double d = haversineKm(lat, lon, st.lat, st.lon);
+                    if (best.size() < k) {
+                        best.push_back({d, &st});
+                        push_heap(best.begin(), best.end());
+                    } else if (d < best.front().first) {
+                        pop_heap(best.begin(), best.end());
+                        best.back() = {d, &st};
+                        push_heap(best.begin(), best.end());
+                    }
+                }
+            });
+        }
+        sort_heap(best.begin(), best.end());
+        return best;
+    }
+
+    static double haversineKm(double lat1, double lon1, double lat2, double lon2) {
+        const double R = 6371.0; // Earth radius in kilometers
+        const double DEG_TO_RAD = M_PI / 180.0;
+        double dLat = (lat2 - lat1) * DEG_TO_RAD;
+        double dLon = (lon2 - lon1) * DEG_TO_RAD;
+        double a = sin(dLat / 2) * sin(dLat / 2) +
+                   cos(lat1 * DEG_TO_RAD) * cos(lat2 * DEG_TO_RAD) *
+                   sin(dLon / 2) * sin(dLon / 2);
+        return R * 2 * atan2(sqrt(a), sqrt(1 - a));
+    }
+
+private:
+    struct Slot {
+        Station st;
+        bool used = false;
+    };
+
+    static constexpr double kCellDeg = 0.5;
+
+    vector<Slot> slots;
+    unordered_map<int, size_t> slotById;
+    vector<size_t> freeSlots;
+    multimap<string, size_t> nameIndex;                  // prefix index
+    unordered_map<long long, vector<size_t>> grid;       // spatial index
+    int minCellY = 0, maxCellY = 0, minCellX = 0, maxCellX = 0;
+    array<vector<uint64_t>, kProvinceCount + 1> provinceBits; // bitmap index, last one = unknown province
+
+    static int cellOf(double deg) { return static_cast<int>(floor(deg / kCellDeg)); }
+    static long long cellKey(int y, int x) { return (static_cast<long long>(y) << 32) ^ static_cast<unsigned int>(x); }
+
+    static bool validCoordinates(double lat, double lon) { return fabs(lat) <= 90 && fabs(lon) <= 180; }
+
+    // Cosine of the latitude furthest from the equator among the query and
+    // the stations' cells; longitude cells are narrowest there
+    double minCosLat(double lat) const {
+        double furthest = max({fabs(lat), fabs(minCellY * kCellDeg), fabs((maxCellY + 1) * kCellDeg)});
+        return cos(min(furthest, 90.0) * M_PI / 180);
+    }
+
+    // Lower bound on the distance to any station in ring r or further out:
+    // those are at least r - 1 cells away in latitude or in longitude. From
+    // the haversine formula, a longitude difference dl alone is worth at
+    // least 2R asin(cosLat sin(dl / 2)), which stays right far from the query.
+    static double ringMinKm(int r, double cosLat) {
+        const double R = 6371.0;
+        double cells = max(0, r - 1) * kCellDeg * M_PI / 180;
+        return min(R * cells, 2 * R * asin(cosLat * sin(min(cells, M_PI) / 2)));
+    }
+
+    // Rings before the first one touching the stations' cells are empty,
+    // rings after the one covering all of them can't add anything
+    int firstRing(int qy, int qx) const { return max({0, minCellY - qy, qy - maxCellY, minCellX - qx, qx - maxCellX}); }
+    int lastRing(int qy, int qx) const {
+        return max({abs(qy - minCellY), abs(qy - maxCellY), abs(qx - minCellX), abs(qx - maxCellX)});
+    }
+
+    // Calls visit with every non-empty cell of ring r around (qy, qx),
+    // walking only the part of the ring inside the stations' bounds
+    template <class Visit>
+    void forRing(int qy, int qx, int r, Visit&& visit) const {
+        int y0 = max(qy - r, minCellY), y1 = min(qy + r, maxCellY);
+        int x0 = max(qx - r, minCellX), x1 = min(qx + r, maxCellX);
+        auto at = [&](int y, int x) {
+            auto it = grid.find(cellKey(y, x));
+            if (it != grid.end())
+                visit(it->second);
+        };
+        for (int y = y0; y <= y1; ++y) {
+            if (abs(y - qy) == r) {
+                for (int x = x0; x <= x1; ++x)
+                    at(y, x);
+            } else {
+                if (qx - r >= x0)
+                    at(y, qx - r);
+                if (r > 0 && qx + r <= x1)
+                    at(y, qx + r);
+            }
+        }
+    }
+
+    void insert(const Station& st) {
+        if (slotById.count(st.id))
+            erase(st.id);
+        size_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = slots.size();
+            slots.emplace_back();
+        }
+        slots[slot].st = st;
+        slots[slot].used = true;
+        slotById[st.id] = slot;
+        indexName(st, slot);
+        indexGrid(st, slot);
+        indexProvince(st, slot);
+    }
+
+    void erase(int id) {
+        auto it = slotById.find(id);
+        if (it == slotById.end())
+            return;
+        size_t slot = it->second;
+        const Station& st = slots[slot].st;
+        unindexName(st, slot);
+        unindexGrid(st, slot);
+        unindexProvince(st, slot);
+        slots[slot].used = false;
+        freeSlots.push_back(slot);
+        slotById.erase(it);
+    }
+
+    void indexName(const Station& st, size_t slot) { nameIndex.emplace(normalizeName(st.cityName), slot); }
+
+    void unindexName(const Station& st, size_t slot) {
+        auto range = nameIndex.equal_range(normalizeName(st.cityName));
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == slot) {
+                nameIndex.erase(it);
+                return;
+            }
+        }
+    }
+
+    void indexGrid(const Station& st, size_t slot) {
+        int y = cellOf(st.lat), x = cellOf(st.lon);
+        if (grid.empty()) {
+            minCellY = maxCellY = y;
+            minCellX = maxCellX = x;
+        }
+        // Bounds only ever grow; they just limit how far nearest() searches
+        minCellY = min(minCellY, y);
+        maxCellY = max(maxCellY, y);
+        minCellX = min(minCellX, x);
+        maxCellX = max(maxCellX, x);
+        grid[cellKey(y, x)].push_back(slot);
+    }
+
+    void unindexGrid(const Station& st, size_t slot) {
+        auto it = grid.find(cellKey(cellOf(st.lat), cellOf(st.lon)));
+        if (it == grid.end())
+            return;
+        auto& cell = it->second;
+        cell.erase(remove(cell.begin(), cell.end(), slot), cell.end());
+        if (cell.empty())
+            grid.erase(it);
+    }
+
+    void indexProvince(const Station& st, size_t slot) {
+        vector<uint64_t>& bits = provinceBits[static_cast<size_t>(st.province)];
+        if (bits.size() <= slot / 64)
+            bits.resize(slot / 64 + 1, 0);
+        bits[slot / 64] |= 1ULL << (slot % 64);
+    }
+
+    void unindexProvince(const Station& st, size_t slot) {
+        vector<uint64_t>& bits = provinceBits[static_cast<size_t>(st.province)];
+        if (slot / 64 < bits.size())
+            bits[slot / 64] &= ~(1ULL << (slot % 64));
+    }
+};
+
+StationCatalog catalog;
+
+// Catalog snapshot and latest sensor values shared between app instances on
+// one machine. The first instance to lock the segment is the writer and
+// keeps it up to date; the others map it read-only and never parse
+// database.json. Readers use the sequence counter as a seqlock (odd = the
+// writer is in the middle of an update).
+class SharedSegment {
+public:
+    static constexpr uint32_t kMagic = 0x4A504F31; // "JPO1"
+    static constexpr uint32_t kLayoutVersion = 2;
+    static constexpr uint32_t kMaxStations = 4096;
+    static constexpr uint32_t kLatestSlots = 16384; // open addressing, power of two
+    static constexpr uint32_t kStringBytes = 256 * 1024;
+
+    struct Latest {
+        int32_t sensorId; // 0 = empty slot
+        int32_t stationId;
+        uint8_t param;
+        int64_t time;     // UTC seconds
+        double value;
+    };
+
+    ~SharedSegment() { close(); }
+
+    bool open(const char* name = "/jpoproject-catalog") {
+#ifdef __unix__
+        fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            LOG_WARN("shm_open failed, running without shared catalog");
+            return false;
+        }
+        // The writer lock lives as long as the process, the kernel drops it on exit
+        writer = flock(fd, LOCK_EX | LOCK_NB) == 0;
+        return writer ? mapWritable() : mapReadOnly();
+#else
+        return false;
+#endif
+    }
+
+    bool isWriter() const { return writer && header; }
+
+    // Readers call this from time to time, so one of them takes over if the writer quits
+    bool tryBecomeWriter() {
+#ifdef __unix__
+        if (writer || fd < 0 || flock(fd, LOCK_EX | LOCK_NB) != 0)
+            return writer;
+        unmap();
+        writer = true;
+        return mapWritable();
+#else
+        return false;
+#endif
+    }
+
+    // 0 until a writer has published a catalog
+    uint64_t generation() const {
+        if (!usable())
+            return 0;
+        return header->generation.load(memory_order_acquire);
+    }
+
+    void publishCatalog(const vector<Station>& list) {
+        if (!isWriter())
+            return;
+        beginWrite();
+        uint32_t count = 0, used = 0;
+        for (const auto& st : list) {
+            if (count == kMaxStations || used + st.cityName.size() + st.provinceName.size() > kStringBytes)
+                break;
+            StationRecord& rec = stations()[count++];
+            rec.id = st.id;
+            rec.province = static_cast<uint8_t>(st.province);
+            rec.cluster = static_cast<int8_t>(st.cluster);
+            rec.lat = st.lat;
+            rec.lon = st.lon;
+            rec.nameOffset = used;
+            rec.nameLength = st.cityName.size();
+            memcpy(strings() + used, st.cityName.data(), st.cityName.size());
+            used += st.cityName.size();
+            rec.provinceOffset = used;
+            rec.provinceLength = st.provinceName.size();
+            memcpy(strings() + used, st.provinceName.data(), st.provinceName.size());
+            used += st.provinceName.size();
+        }
+        header->stationCount = count;
+        header->generation.fetch_add(1, memory_order_relaxed);
+        endWrite();
+    }
+
+    bool readCatalog(vector<Station>& list, uint64_t* generationRead = nullptr) const {
+        if (!usable())
+            return false;
+        return readConsistent([&] {
+            list.clear();
+            uint32_t count = min(header->stationCount, kMaxStations);
+            for (uint32_t i = 0; i < count; ++i) {
+                const StationRecord& rec = stations()[i];
+                if (rec.nameOffset + rec.nameLength > kStringBytes || rec.provinceOffset + rec.provinceLength > kStringBytes)
+                    return false;
+                Station st;
+                st.id = rec.id;
+                st.province = static_cast<Province>(rec.province);
+                st.cluster = rec.cluster;
+                st.lat = rec.lat;
+                st.lon = rec.lon;
+                st.cityName.assign(strings() + rec.nameOffset, rec.nameLength);
+                st.provinceName.assign(strings() + rec.provinceOffset, rec.provinceLength);
+                list.push_back(st);
+            }
+            if (generationRead)
+                *generationRead = header->generation.load(memory_order_relaxed);
+            return header->generation.load(memory_order_relaxed) > 0;
+        });
+    }
+
+    void publishLatest(const Latest& value) {
+        if (!isWriter() || value.sensorId == 0)
+            return;
+        beginWrite();
+        for (uint32_t i = 0, h = slotOf(value.sensorId); i < kLatestSlots; ++i, h = (h + 1) & (kLatestSlots - 1)) {
+            Latest& slot = latest()[h];
+            if (slot.sensorId == value.sensorId || slot.sensorId == 0) {
+                if (slot.sensorId == 0 || value.time >= slot.time)
+                    slot = value;
+                break;
+            }
+        }
+        endWrite();
+    }
+
+    bool readLatest(int sensorId, Latest& out) const {
+        if (!usable())
+            return false;
+        return readConsistent([&] {
+            for (uint32_t i = 0, h = slotOf(sensorId); i < kLatestSlots; ++i, h = (h + 1) & (kLatestSlots - 1)) {
+                const Latest& slot = latest()[h];
+                if (slot.sensorId == 0)
+                    return false;
+                if (slot.sensorId == sensorId) {
+                    out = slot;
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t layoutVersion;
+        atomic<uint64_t> sequence;
+        atomic<uint64_t> generation; // bumped on every catalog publish
+        uint32_t stationCount;
+        uint32_t reserved;
+    };
+    struct StationRecord {
+        int32_t id;
+        uint8_t province;
+        int8_t cluster;
+        double lat, lon;
+        uint32_t nameOffset, nameLength;
+        uint32_t provinceOffset, provinceLength;
+    };
+
+    static constexpr size_t kStationsOffset = 64;
+    static constexpr size_t kLatestOffset = kStationsOffset + kMaxStations * sizeof(StationRecord);
+    static constexpr size_t kStringsOffset = kLatestOffset + kLatestSlots * sizeof(Latest);
+    static constexpr size_t kSize = kStringsOffset + kStringBytes;
+    static_assert(sizeof(Header) <= kStationsOffset, "header does not fit");
+
+    int fd = -1;
+    bool writer = false;
+    Header* header = nullptr;
+
+    char* base() const { return reinterpret_cast<char*>(header); }
+    StationRecord* stations() const { return reinterpret_cast<StationRecord*>(base() + kStationsOffset); }
+    Latest* latest() const { return reinterpret_cast<Latest*>(base() + kLatestOffset); }
+    char* strings() const { return base() + kStringsOffset; }
+    static uint32_t slotOf(int sensorId) { return (static_cast<uint32_t>(sensorId) * 2654435761u) & (kLatestSlots - 1); }
+
+    bool usable() const {
+        return header && header->magic == kMagic && header->layoutVersion == kLayoutVersion;
+    }
+
+    void beginWrite() {
+        header->sequence.store(header->sequence.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+
+    void endWrite() { header->sequence.fetch_add(1, memory_order_release); }
+
+    // Retries the read until no write overlapped it; gives up after a while
+    // in case a writer died halfway through an update
+    template <class F>
+    bool readConsistent(F&& read) const {
+        for (int attempt = 0; attempt < 1000; ++attempt) {
+            uint64_t before = header->sequence.load(memory_order_acquire);
+            if (before & 1) {
+                this_thread::yield();
+                continue;
+            }
+            bool ok = read();
+            atomic_thread_fence(memory_order_acquire);
+            if (header->sequence.load(memory_order_relaxed) == before)
+                return ok;
+        }
+        return false;
+    }
+
+#ifdef __unix__
+    bool mapWritable() {
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (static_cast<size_t>(info.st_size) != kSize && ftruncate(fd, kSize) != 0))
+            return false;
+        void* mem = mmap(nullptr, kSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mem == MAP_FAILED)
+            return false;
+        header = static_cast<Header*>(mem);
+        if (header->magic != kMagic || header->layoutVersion != kLayoutVersion) {
+            // New segment or one from an older build: start from scratch
+            memset(mem, 0, kSize);
+            header->layoutVersion = kLayoutVersion;
+            header->magic = kMagic;
+        } else if (header->sequence.load() & 1) {
+            // Previous writer died inside an update
+            header->sequence.fetch_add(1);
+        }
+        return true;
+    }
+
+    bool mapReadOnly() {
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) != kSize)
+            return false; // writer has not set it up (yet), use the json files
+        void* mem = mmap(nullptr, kSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (mem == MAP_FAILED)
+            return false;
+        header = static_cast<Header*>(mem);
+        return true;
+    }
+
+    void unmap() {
+        if (header)
+            munmap(header, kSize);
+        header = nullptr;
+    }
+
+    void close() {
+        unmap();
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+#else
+    void close() {}
+#endif
+};
+
+SharedSegment sharedSegment;
+uint64_t sharedGeneration = 0; // catalog generation this instance has loaded
+
+// Reads the stations stored in database.json (the previous snapshot)
+vector<Station> loadDatabase(const string& filename) {
+    vector<Station> list;
+    string content;
+    if (!storedFiles.read(filename, content) || content.empty())
+        return list;
+    try {
+        nlohmann::json jsonDatabase = nlohmann::json::parse(content);
+        for (const auto& entry : jsonDatabase)
+            list.push_back(stationFromJson(entry));
+    } catch (nlohmann::json::exception& e) {
+        LOG_ERROR("Could not read {}: {}", filename, e.what());
+        list.clear();
+    }
+    return list;
+}
+
+void saveDatabase(const string& filename) {
+    nlohmann::json jsonDatabase = nlohmann::json::array(); // Creating json file with cities' names
+    for (const auto& st : catalog.snapshot())
+        jsonDatabase.push_back(stationToJson(st));
+
+    // Writing the JSON data to the file
+    if (!storedFiles.write(filename, jsonDatabase.dump(4)))  // Indentation of 4 for better readability
+        LOG_ERROR("Could not write {}!", filename);
+}
+
+// Builds the station list out of the findAll response
+vector<Station> stationsFromFindAll(const nlohmann::json& jsonData) {
+    vector<Station> list;
+    for (const auto& station : jsonData) {
+        if (station.contains("city")) {
+            Station st;
+            st.cityName = station["city"]["name"].get<string>();
+            st.id = station["id"].get<int>();
+            st.provinceName = station["city"]["commune"]["provinceName"].get<string>();
+            st.province = provinceFromName(st.provinceName);
+            if (!parseDecimal(station["gegrLat"].get<string>(), st.lat) || !parseDecimal(station["gegrLon"].get<string>(), st.lon) ||
+                fabs(st.lat) > 90 || fabs(st.lon) > 180) {
+                LOG_WARN("Bad coordinates for station {}", st.id);
+                continue;
+            }
+            list.push_back(st);
+        }
+    }
+    return list;
+}
+
+void refreshCatalog(wxWindow* parent) {
+    TraceSpan span("refreshCatalog");
+    // Opening file in C++ (GIVEN JSON)
+    int response = wxNO;
+    ifstream file("findAllmine.json");
+    if (!file.is_open() || file.peek() == ifstream::traits_type::eof()) {
+        file.close();
+        fetchAndSaveData(apiUrl("station/findAll"), "findAllmine.json");
+    } else {
+        // Show a wxMessageDialog for user prompt about data update
+        response = messageBox("Do you wish to download the database?", "Update Database", wxYES_NO | wxICON_QUESTION, parent);
+
+        if (response == wxYES) {
+            file.close();
+            fetchAndSaveData(apiUrl("station/findAll"), "findAllmine.json");
+        } else {
+            LOG_INFO("User chose not to update the database.");
+        }
+    }
+    file.close();
+
+    // The previous snapshot is what database.json holds right now
+    catalog.load(loadDatabase("database.json"));
+    if (response != wxYES && catalog.size() > 0)
+        return;
+
+    string content;
+    nlohmann::json jsonData;
+    try {
+        if (!storedFiles.read("findAllmine.json", content))
+            return;
+        jsonData = nlohmann::json::parse(content);
+    } catch (nlohmann::json::exception& e) {
+        LOG_ERROR("Could not read findAllmine.json: {}", e.what());
+        return;
+    }
+
+    // Only patch what changed since the last refresh; findAll knows nothing
+    // about the station groups, those stay as they were
+    vector<Station> fresh = stationsFromFindAll(jsonData);
+    for (auto& st : fresh)
+        if (const Station* old = catalog.byId(st.id))
+            st.cluster = old->cluster;
+    CatalogDiff diff = catalog.diff(fresh);
+    LOG_INFO("Catalog refresh: {} added, {} removed, {} moved/renamed", diff.added.size(), diff.removed.size(), diff.changed.size());
+    if (diff.empty())
+        return;
+    catalog.apply(diff);
+    saveDatabase("database.json");
+}
+
+void init(wxWindow* parent) {
+    storedFiles.startBackgroundScan();
+    sharedSegment.open();
+    // Another instance owns the catalog, take it from shared memory
+    if (!sharedSegment.isWriter()) {
+        vector<Station> list;
+        if (sharedSegment.readCatalog(list, &sharedGeneration)) {
+            catalog.load(list);
+            return;
+        }
+    }
+    refreshCatalog(parent);
+    if (sharedSegment.isWriter())
+        sharedSegment.publishCatalog(catalog.snapshot());
+}
+
+// Reader instances: patch the catalog when the writer published a new one
+bool syncCatalogFromShared() {
+    if (sharedSegment.isWriter() || sharedSegment.generation() == sharedGeneration)
+        return false;
+    vector<Station> list;
+    if (!sharedSegment.readCatalog(list, &sharedGeneration))
+        return false;
+    catalog.apply(catalog.diff(list));
+    return true;
+}
+
+
+
+
+// Newest non-null value of a getData response goes to the shared latest-values table
+void publishLatestValue(int stationID, int sensorID, const nlohmann::json& sensorData) {
+    SharedSegment::Latest latest{sensorID, stationID, static_cast<uint8_t>(paramFromCode(sensorData.value("key", ""))), 0, 0};
+    bool found = false;
+    const nlohmann::json& values = sensorData["values"];
+    vector<int64_t> times = batchTimesUtc(values);
+    for (size_t i = 0; i < values.size(); ++i) {
+        const auto& entry = values[i];
+        int64_t t = times[i];
+        if (!entry.contains("value") || entry["value"].is_null() || t == numeric_limits<int64_t>::min())
+            continue;
+        if (!found || t > latest.time) {
+            latest.time = t;
+            latest.value = entry["value"].get<double>();
+            found = true;
+        }
+    }
+    if (found)
+        sharedSegment.publishLatest(latest);
+}
+
+// Back to the json shape GraphPanel draws (newest first, null = missing)
+nlohmann::json seriesToJson(const Series& series, int id, const string& code) {
+    nlohmann::json sensor;
+    sensor["id"] = id;
+    sensor["param"]["paramCode"] = code;
+    sensor["param"]["paramName"] = code;
+    sensor["values"] = nlohmann::json::array();
+    for (size_t i = series.size(); i-- > 0;) {
+        nlohmann::json entry;
+        entry["date"] = formatTimestamp(warsawTime.utcToLocal(series.time[i]));
+        entry["t"] = series.time[i];
+        entry["value"] = series.isValid(i) ? nlohmann::json(series.value[i]) : nlohmann::json(nullptr);
+        sensor["values"].push_back(entry);
+    }
+    return sensor;
+}
+
+// Bumped whenever new values are merged into <stationID>.json; derived series
+// cached for an older version are recomputed
+unordered_map<int, uint64_t> stationDataVersion;
+
+// Rolling windows over the last `window` rows of a column (values plus
+// validity bitmap), one step per row whatever the window: a sliding sum for
+// sums and means, a monotonic queue of row numbers for max/min. A window
+// needs 75% of its rows present (the 18 out of 24 hours rule for daily
+// means), otherwise the output row is missing. out/outValid must be zeroed.
+enum class Rolling { Sum, Mean, Max, Min };
+
+inline bool windowCovered(size_t present, size_t window) { return present * 4 >= window * 3; }
+
+void rollingWindow(Rolling op, const double* value, const uint64_t* valid, size_t n, size_t window, double* out, uint64_t* outValid) {
+    auto present = [valid](size_t i) { return (valid[i / 64] >> (i % 64)) & 1; };
+    if (window == 0)
+        return;
+    size_t count = 0;
+    if (op == Rolling::Sum || op == Rolling::Mean) {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (present(i)) {
+                sum += value[i];
+                ++count;
+            }
+            if (i >= window && present(i - window)) {
+                sum -= value[i - window];
+                --count;
+            }
+            // Subtracting lets rounding errors pile up, start over once per window
+            if (i % window == window - 1) {
+                sum = 0;
+                for (size_t j = i + 1 - window; j <= i; ++j)
+                    if (present(j))
+                        sum += value[j];
+            }
+            if (windowCovered(count, window)) {
+                out[i] = op == Rolling::Mean ? sum / count : sum;
+                outValid[i / 64] |= 1ULL << (i % 64);
+            } else {
+                out[i] = NAN;
+            }
+        }
+        return;
+    }
+    // Row numbers in the window whose values only fall (max) or rise (min)
+    // from the front, so the front is the answer
+    vector<size_t> queue(n);
+    size_t head = 0, tail = 0;
+    bool isMax = op == Rolling::Max;
+    for (size_t i = 0; i < n; ++i) {
+        if (present(i)) {
+            while (tail > head && (isMax ? value[queue[tail - 1]] <= value[i] : value[queue[tail - 1]] >= value[i]))
+                --tail;
+            queue[tail++] = i;
+            ++count;
+        }
+        if (i >= window && present(i - window))
+            --count;
+        while (head < tail && queue[head] + window <= i)
+            ++head;
+        if (head < tail && windowCovered(count, window)) {
+            out[i] = value[queue[head]];
+            outValid[i / 64] |= 1ULL << (i % 64);
+        } else {
+            out[i] = NAN;
+        }
+    }
+}
+
+// The same over a sensor's Series: put on the hourly grid first, so the
+// window is in hours even where the source skips missing hours
+Series rollingSeries(const Series& series, Rolling op, size_t hours) {
+    AlignedView view = alignOnGrid({&series}, JoinSpec());
+    Series out;
+    out.time = view.grid;
+    vector<double> value(view.size());
+    vector<uint64_t> valid((view.size() + 63) / 64, 0);
+    for (size_t i = 0; i < view.size(); ++i) {
+        value[i] = view.value(0, i);
+        if (view.has(0, i))
+            valid[i / 64] |= 1ULL << (i % 64);
+    }
+    out.value.assign(view.size(), NAN);
+    out.valid.assign(valid.size(), 0);
+    rollingWindow(op, value.data(), valid.data(), view.size(), hours, out.value.data(), out.valid.data());
+    return out;
+}
+
+// Derived series such as "PM2.5 / PM10", "NO + NO2" or "PM10 > 50".
+// Names are the paramCode of a sensor of the station. The text is compiled
+// once into a list of column operations on registers; evaluating it runs
+// each operation as a tight loop over the aligned columns and combines the
+// validity bitmaps word by word, so a missing input makes the output missing.
+// Comparisons give 1/0, division by zero gives a missing value.
+// Rolling functions take a window in grid steps (hours by default):
+// rollmean(PM10, 24), rollmax(x, n), rollmin(x, n), rollsum(PM10 > 50, 8760)
+// for running exceedances; daymax(x) is the maximum over each local day, so
+// daymax(rollmean(O3, 8)) is the ozone maximum daily 8-hour mean.
+class DerivedExpression {
+public:
+    bool compile(const string& source, string& error) {
+        text = source;
+        pos = 0;
+        program.clear();
+        names.clear();
+        registers = 0;
+        failure.clear();
+        int result = parseComparison();
+        skipSpaces();
+        if (failure.empty() && pos != text.size())
+            failure = "unexpected '" + text.substr(pos, 1) + "'";
+        error = failure;
+        output = result;
+        return failure.empty();
+    }
+
+    // Series names the expression reads, in input order for evaluate()
+    const vector<string>& inputs() const { return names; }
+
+    // Inputs are the view's sources, in inputs() order
+    Series evaluate(const AlignedView& aligned) const {
+        Series out;
+        size_t n = aligned.size();
+        size_t words = (n + 63) / 64;
+        vector<vector<double>> value(registers, vector<double>(n));
+        vector<vector<uint64_t>> valid(registers, vector<uint64_t>(words));
+        uint64_t tailMask = n % 64 ? (1ULL << (n % 64)) - 1 : ~0ULL;
+
+        for (const Op& op : program) {
+            double* d = value[op.dst].data();
+            uint64_t* dv = valid[op.dst].data();
+            const double* a = op.a >= 0 ? value[op.a].data() : nullptr;
+            const double* b = op.b >= 0 ? value[op.b].data() : nullptr;
+            const uint64_t* av = op.a >= 0 ? valid[op.a].data() : nullptr;
+            const uint64_t* bv = op.b >= 0 ? valid[op.b].data() : nullptr;
+            switch (op.code) {
+            case Load: {
+                // Gather through the join's row numbers
+                const vector<int32_t>& rows = aligned.rows[op.input];
+                const double* src = aligned.sources[op.input]->value.data();
+                for (size_t i = 0; i < n; ++i)
+                    d[i] = rows[i] >= 0 ? src[rows[i]] : NAN;
+                for (size_t i = 0; i < n; ++i)
+                    dv[i / 64] |= static_cast<uint64_t>(rows[i] >= 0) << (i % 64);
+                continue;
+            }
+            case RollSum:
+            case RollMean:
+            case RollMax:
+            case RollMin:
+                rollingWindow(static_cast<Rolling>(op.code - RollSum), a, av, n, static_cast<size_t>(op.constant), d, dv);
+                continue;
+            case DayMax:
+                dayMax(aligned.grid, a, av, d, dv);
+                continue;
+            case Const:
+                fill(d, d + n, op.constant);
+                fill(dv, dv + words, ~0ULL);
+                break;
+            case Neg:    for (size_t i = 0; i < n; ++i) d[i] = -a[i]; break;
+            case Abs:    for (size_t i = 0; i < n; ++i) d[i] = fabs(a[i]); break;
+            case Add:    for (size_t i = 0; i < n; ++i) d[i] = a[i] + b[i]; break;
+            case Sub:    for (size_t i = 0; i < n; ++i) d[i] = a[i] - b[i]; break;
+            case Mul:    for (size_t i = 0; i < n; ++i) d[i] = a[i] * b[i]; break;
+            case Div:    for (size_t i = 0; i < n; ++i) d[i] = a[i] / b[i]; break;
+            case Min:    for (size_t i = 0; i < n; ++i) d[i] = a[i] < b[i] ? a[i] : b[i]; break;
+            case Max:    for (size_t i = 0; i < n; ++i) d[i] = a[i] > b[i] ? a[i] : b[i]; break;
+            case Less:   for (size_t i = 0; i < n; ++i) d[i] = a[i] < b[i]; break;
+            case LessEq: for (size_t i = 0; i < n; ++i) d[i] = a[i] <= b[i]; break;
+            case More:   for (size_t i = 0; i < n; ++i) d[i] = a[i] > b[i]; break;
+            case MoreEq: for (size_t i = 0; i < n; ++i) d[i] = a[i] >= b[i]; break;
+            }
+            if (op.code == Const)
+                continue;
+            if (bv) {
+                for (size_t w = 0; w < words; ++w)
+                    dv[w] = av[w] & bv[w];
+            } else {
+                copy(av, av + words, dv);
+            }
+            if (op.code == Div) {
+                // x / 0 is missing, not inf
+                for (size_t w = 0; w < words; ++w) {
+                    uint64_t nonZero = 0;
+                    size_t base = w * 64, count = min<size_t>(64, n - base);
+                    for (size_t j = 0; j < count; ++j)
+                        nonZero |= static_cast<uint64_t>(b[base + j] != 0) << j;
+                    dv[w] &= nonZero;
+                }
+            }
+        }
+        if (words)
+            valid[output].back() &= tailMask;
+
+        out.time = aligned.grid;
+        out.value = move(value[output]);
+        out.valid = move(valid[output]);
+        for (size_t i = 0; i < n; ++i) {
+            if (!out.isValid(i))
+                out.value[i] = NAN;
+        }
+        return out;
+    }
+
+private:
+    enum Code { Load, Const, Neg, Abs, Add, Sub, Mul, Div, Min, Max, Less, LessEq, More, MoreEq, RollSum, RollMean, RollMax, RollMin, DayMax };
+    static_assert(RollMin - RollSum == static_cast<int>(Rolling::Min), "Rolling order");
+    struct Op {
+        Code code;
+        int dst;
+        int a = -1;
+        int b = -1;
+        int input = -1;
+        double constant = 0;
+    };
+
+    string text;
+    size_t pos = 0;
+    string failure;
+    vector<Op> program;
+    vector<string> names;
+    int registers = 0;
+    int output = 0;
+
+    int emit(Code code, int a = -1, int b = -1) {
+        Op op{code, registers++, a, b};
+        program.push_back(op);
+        return op.dst;
+    }
+
+    void skipSpaces() {
+        while (pos < text.size() && isspace(static_cast<unsigned char>(text[pos])))
+            ++pos;
+    }
+
+    bool accept(const char* token) {
+        skipSpaces();
+        size_t len = strlen(token);
+        if (text.compare(pos, len, token) != 0)
+            return false;
+        pos += len;
+        return true;
+    }
+
+    int fail(const string& message) {
+        if (failure.empty())
+            failure = message + " at position " + to_string(pos + 1);
+        return emit(Const);
+    }
+
+    int parseComparison() {
+        int left = parseSum();
+        if (accept("<="))
+            return emit(LessEq, left, parseSum());
+        if (accept(">="))
+            return emit(MoreEq, left, parseSum());
+        if (accept("<"))
+            return emit(Less, left, parseSum());
+        if (accept(">"))
+            return emit(More, left, parseSum());
+        return left;
+    }
+
+    int parseSum() {
+        int left = parseProduct();
+        for (;;) {
+            if (accept("+"))
+                left = emit(Add, left, parseProduct());
+            else if (accept("-"))
+                left = emit(Sub, left, parseProduct());
+            else
+                return left;
+        }
+    }
+
+    int parseProduct() {
+        int left = parseUnary();
+        for (;;) {
+            if (accept("*"))
+                left = emit(Mul, left, parseUnary());
+            else if (accept("/"))
+                left = emit(Div, left, parseUnary());
+            else
+                return left;
+        }
+    }
+
+    int parseUnary() {
+        if (accept("-"))
+            return emit(Neg, parseUnary());
+        return parsePrimary();
+    }
+
+    int parsePrimary() {
+        skipSpaces();
+        if (pos >= text.size())
+            return fail("unexpected end");
+        if (accept("(")) {
+            int inner = parseComparison();
+            if (!accept(")"))
+                return fail("missing ')'");
+            return inner;
+        }
+        if (isDigit(text[pos]) || text[pos] == '.') {
+            double number = 0;
+            const char* end = parseDecimal(text.data() + pos, text.data() + text.size(), number);
+            if (!end)
+                return fail("bad number");
+            pos = end - text.data();
+            int reg = emit(Const);
+            program.back().constant = number;
+            return reg;
+        }
+        if (!isalpha(static_cast<unsigned char>(text[pos])))
+            return fail("unexpected '" + text.substr(pos, 1) + "'");
+
+        // Names may contain dots and digits (PM2.5)
+        size_t start = pos;
+        while (pos < text.size() && (isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '.' || text[pos] == '_'))
+            ++pos;
+        string name = text.substr(start, pos - start);
+        if (accept("("))
+            return parseCall(name);
+
+        auto it = find(names.begin(), names.end(), name);
+        int input = static_cast<int>(it - names.begin());
+        if (it == names.end())
+            names.push_back(name);
+        int reg = emit(Load);
+        program.back().input = input;
+        return reg;
+    }
+
+    int parseCall(const string& name) {
+        vector<int> args;
+        if (!accept(")")) {
+            do {
+                args.push_back(parseComparison());
+            } while (accept(","));
+            if (!accept(")"))
+                return fail("missing ')'");
+        }
+        if (name == "abs" && args.size() == 1)
+            return emit(Abs, args[0]);
+        if (name == "min" && args.size() == 2)
+            return emit(Min, args[0], args[1]);
+        if (name == "max" && args.size() == 2)
+            return emit(Max, args[0], args[1]);
+        if (name == "daymax" && args.size() == 1)
+            return emit(DayMax, args[0]);
+        static const map<string, Code> rolling = {{"rollsum", RollSum}, {"rollmean", RollMean}, {"rollmax", RollMax}, {"rollmin", RollMin}};
+        auto it = rolling.find(name);
+        if (it != rolling.end() && args.size() == 2) {
+            // The window has to be a plain number of steps
+            const Op& window = program[args[1]];
+            if (window.code != Const || window.constant < 1 || window.constant > 100000 || window.constant != floor(window.constant))
+                return fail(name + " needs a whole number of steps as window");
+            int reg = emit(it->second, args[0]);
+            program.back().constant = window.constant;
+            return reg;
+        }
+        return fail("unknown function " + name);
+    }
+
+    // Maximum of the present values of each local calendar day, on every row
+    // of that day; a day needs 75% of its hours like the rolling windows,
+    // counted against the whole day (23 or 25 hours on DST days), so the
+    // partial first and last day of the grid don't pass on a few readings
+    static void dayMax(const vector<int64_t>& grid, const double* value, const uint64_t* valid, double* out, uint64_t* outValid) {
+        size_t n = grid.size();
+        vector<int64_t> local(n);
+        warsawTime.utcToLocal(grid.data(), local.data(), n);
+        for (size_t begin = 0, end; begin < n; begin = end) {
+            int64_t day = floorDiv(local[begin], 86400);
+            double best = NAN;
+            size_t count = 0;
+            for (end = begin; end < n && floorDiv(local[end], 86400) == day; ++end) {
+                if ((valid[end / 64] >> (end % 64)) & 1) {
+                    best = count++ ? max(best, value[end]) : value[end];
+                }
+            }
+            size_t dayHours = static_cast<size_t>((warsawTime.localToUtc((day + 1) * 86400) - warsawTime.localToUtc(day * 86400)) / 3600);
+            bool covered = windowCovered(count, dayHours);
+            for (size_t i = begin; i < end; ++i) {
+                out[i] = covered ? best : NAN;
+                if (covered)
+                    outValid[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    }
+};
+
+// Evaluates an expression over the sensors of one station. Results are kept
+// until new data is merged into that station's file.
+class DerivedSeriesCache {
+public:
+    bool get(int stationID, const nlohmann::json& stationData, const string& expression, Series& result, string& error,
+             const JoinSpec& join = JoinSpec()) {
+        string key = to_string(stationID) + "|" + to_string(join.intersect) + "|" + expression;
+        uint64_t version = stationDataVersion[stationID];
+        auto it = cache.find(key);
+        if (it != cache.end() && it->second.first == version) {
+            result = it->second.second;
+            return true;
+        }
+
+        DerivedExpression compiled;
+        if (!compiled.compile(expression, error))
+            return false;
+        vector<Series> columns;
+        for (const string& name : compiled.inputs()) {
+            const nlohmann::json* found = nullptr;
+            for (const auto& sensor : stationData) {
+                if (sensor.contains("param") && sensor["param"].value("paramCode", "") == name && sensor.contains("values"))
+                    found = &sensor;
+            }
+            if (!found) {
+                error = "no downloaded data for " + name;
+                return false;
+            }
+            columns.push_back(seriesFromJson(*found));
+        }
+        vector<const Series*> inputs;
+        for (const auto& column : columns)
+            inputs.push_back(&column);
+        result = compiled.evaluate(alignOnGrid(inputs, join));
+        cache[key] = {version, result};
+        return true;
+    }
+
+private:
+    unordered_map<string, pair<uint64_t, Series>> cache;
+};
+
+DerivedSeriesCache derivedSeriesCache;
+
+// Threshold alerts from alerts.json, e.g.
+//   [{"stationId": 944, "param": "PM10", "threshold": 50, "hours": 3},
+//    {"sensorId": 6085, "param": "PM10", "threshold": 100}]
+// A rule fires when the value goes above the threshold (or stays above it for
+// "hours" consecutive hourly samples) and re-arms once it drops back. Rules
+// are indexed by (sensor, param) and (station, param), so a merged batch only
+// looks at the rules that watch it, and each rule remembers per sensor where
+// its run stands so old samples are never evaluated twice.
+struct AlertRun {
+    int64_t lastTime = numeric_limits<int64_t>::min();
+    int64_t runStart = 0;
+    int64_t runLast = 0;
+    int runSamples = 0;
+    bool firing = false;
+};
+
+struct AlertRule {
+    int sensorId = 0;  // 0 = any sensor of the station
+    int stationId = 0;
+    Param param = Param::Count;
+    double threshold = 0;
+    int hours = 0;
+
+    unordered_map<int, AlertRun> runs; // by sensor id, a station rule watches each sensor on its own
+};
+
+struct AlertEvent {
+    size_t rule;
+    int stationId;
+    int sensorId;
+    int64_t time;  // sample that made the rule fire
+    double value;
+};
+
+class AlertEngine {
+public:
+    bool load(const string& filename) {
+        ifstream file(filename);
+        if (!file.is_open())
+            return false;
+        try {
+            nlohmann::json jsonRules;
+            file >> jsonRules;
+            rules.clear();
+            bySensor.clear();
+            byStation.clear();
+            for (const auto& entry : jsonRules) {
+                AlertRule rule;
+                rule.sensorId = entry.value("sensorId", 0);
+                rule.stationId = entry.value("stationId", 0);
+                rule.param = paramFromCode(entry.value("param", ""));
+                rule.threshold = entry.value("threshold", 0.0);
+                rule.hours = entry.value("hours", 0);
+                if (rule.param == Param::Count || (rule.sensorId == 0 && rule.stationId == 0)) {
+                    LOG_WARN("Skipping alert rule {}", entry.dump());
+                    continue;
+                }
+                add(rule);
+            }
+        } catch (nlohmann::json::exception& e) {
+            LOG_ERROR("Could not read {}: {}", filename, e.what());
+            return false;
+        }
+        return true;
+    }
+
+    void add(const AlertRule& rule) {
+        size_t index = rules.size();
+        rules.push_back(rule);
+        if (rule.sensorId)
+            bySensor[key(rule.sensorId, rule.param)].push_back(index);
+        else
+            byStation[key(rule.stationId, rule.param)].push_back(index);
+    }
+
+    size_t size() const { return rules.size(); }
+    const AlertRule& rule(size_t index) const { return rules[index]; }
+
+    // samples: (time, value) sorted by time, NaN for missing values
+    vector<AlertEvent> evaluate(int stationId, int sensorId, Param param, const vector<pair<int64_t, double>>& samples) {
+        vector<AlertEvent> events;
+        auto run = [&](const unordered_map<uint64_t, vector<size_t>>& index, int id) {
+            auto it = index.find(key(id, param));
+            if (it == index.end())
+                return;
+            for (size_t r : it->second) {
+                if (rules[r].stationId && rules[r].stationId != stationId)
+                    continue;
+                AlertEvent event{r, stationId, sensorId, 0, 0};
+                if (step(rules[r].runs[sensorId], rules[r], samples, event))
+                    events.push_back(event);
+            }
+        };
+        run(bySensor, sensorId);
+        run(byStation, stationId);
+        return events;
+    }
+
+private:
+    vector<AlertRule> rules;
+    unordered_map<uint64_t, vector<size_t>> bySensor;
+    unordered_map<uint64_t, vector<size_t>> byStation;
+
+    static uint64_t key(int id, Param param) { return (static_cast<uint64_t>(static_cast<uint32_t>(id)) << 8) | paramIndex(param); }
+
+    // Advances one sensor's run of the rule over the new samples; reports the
+    // last time it fired
+    static bool step(AlertRun& run, const AlertRule& rule, const vector<pair<int64_t, double>>& samples, AlertEvent& event) {
+        bool fired = false;
+        for (const auto& [t, v] : samples) {
+            if (t <= run.lastTime)
+                continue;
+            // A missing value or a hole in the hourly series ends the run
+            if (isnan(v) || (run.runSamples > 0 && t - run.runLast > 3600))
+                run.runSamples = 0;
+            if (!isnan(v)) {
+                if (v > rule.threshold) {
+                    if (run.runSamples == 0)
+                        run.runStart = t;
+                    ++run.runSamples;
+                    run.runLast = t;
+                    if (!run.firing && run.runSamples >= max(rule.hours, 1)) {
+                        run.firing = true;
+                        fired = true;
+                        event.time = t;
+                        event.value = v;
+                    }
+                } else {
+                    run.firing = false;
+                }
+            }
+            run.lastTime = t;
+        }
+        return fired;
+    }
+};
+
+AlertEngine alertEngine;
+
+void notifyAlerts(const vector<AlertEvent>& events) {
+    for (const auto& event : events) {
+        const AlertRule& rule = alertEngine.rule(event.rule);
+        const Station* st = catalog.byId(event.stationId);
+        wxString title;
+        title.Printf("%s above %.0f", string(kParamCodes[paramIndex(rule.param)]), rule.threshold);
+        wxString message;
+        message.Printf("%s (station %d, sensor %d): %.1f at %s",
+                       wxString::FromUTF8(st ? st->cityName : string("?")), event.stationId, event.sensorId,
+                       event.value, formatTimestamp(warsawTime.utcToLocal(event.time)));
+        if (rule.hours > 1)
+            message += wxString::Format(", above for %d h", rule.hours);
+        // Notifications have to be shown from the GUI thread
+        wxTheApp->CallAfter([title, message] {
+            wxNotificationMessage notification(title, message);
+            notification.Show();
+        });
+    }
+}
+
+// Runs the alert rules over the values a merge just added
+void evaluateAlerts(int stationID, int sensorID, Param param, const vector<nlohmann::json>& added) {
+    if (alertEngine.size() == 0 || added.empty())
+        return;
+    vector<pair<int64_t, double>> samples;
+    for (const auto& entry : added) {
+        int64_t t;
+        if (!entryUtc(entry, t))
+            continue;
+        bool missing = !entry.contains("value") || entry["value"].is_null();
+        samples.push_back({t, missing ? NAN : entry["value"].get<double>()});
+    }
+    sort(samples.begin(), samples.end());
+    notifyAlerts(alertEngine.evaluate(stationID, sensorID, param, samples));
+}
+
+// Metadata of every sensor in the country, kept apart from the station
+// files in sensors.json. Looked up by sensor id or by (station, parameter)
+// in O(1); safe to use from the sync threads and the UI at the same time.
+struct SensorInfo {
+    int id = 0;
+    int stationId = 0;
+    string paramCode;
+    string paramName;
+    Param param = Param::Count;
+};
+
+SensorInfo sensorFromJson(const nlohmann::json& entry) {
+    SensorInfo info;
+    info.id = entry["id"].get<int>();
+    info.stationId = entry.value("stationId", 0);
+    if (entry.contains("param")) {
+        info.paramCode = entry["param"].value("paramCode", "");
+        info.paramName = entry["param"].value("paramName", "");
+    }
+    info.param = paramFromCode(info.paramCode);
+    return info;
+}
+
+nlohmann::json sensorToJson(const SensorInfo& info) {
+    return {{"id", info.id}, {"stationId", info.stationId}, {"param", {{"paramCode", info.paramCode}, {"paramName", info.paramName}}}};
+}
+
+class SensorRegistry {
+public:
+    ~SensorRegistry() { stop(); }
+
+    bool find(int sensorId, SensorInfo& info) const {
+        lock_guard<mutex> lock(m);
+        auto it = byId.find(sensorId);
+        if (it == byId.end())
+            return false;
+        info = it->second;
+        return true;
+    }
+
+    bool find(int stationId, Param param, SensorInfo& info) const {
+        lock_guard<mutex> lock(m);
+        auto it = byStationParam.find(key(stationId, param));
+        if (it == byStationParam.end())
+            return false;
+        info = byId.at(it->second);
+        return true;
+    }
+
+    // true once the sensor list of the station was downloaded, even an empty one
+    bool knowsStation(int stationId) const {
+        lock_guard<mutex> lock(m);
+        return byStation.count(stationId) > 0;
+    }
+
+    vector<SensorInfo> atStation(int stationId) const {
+        lock_guard<mutex> lock(m);
+        vector<SensorInfo> found;
+        auto it = byStation.find(stationId);
+        if (it != byStation.end())
+            for (int id : it->second)
+                found.push_back(byId.at(id));
+        return found;
+    }
+
+    size_t size() const {
+        lock_guard<mutex> lock(m);
+        return byId.size();
+    }
+
+    // Replaces what is known about one station with a station/sensors response
+    void setStation(int stationId, const nlohmann::json& sensors) {
+        vector<SensorInfo> list;
+        for (const auto& entry : sensors) {
+            if (!entry.contains("param")) // station files also hold value-only entries
+                continue;
+            try {
+                list.push_back(sensorFromJson(entry));
+                list.back().stationId = stationId;
+            } catch (nlohmann::json::exception& e) {
+                LOG_WARN("Skipping sensor of station {}: {}", stationId, e.what());
+            }
+        }
+        lock_guard<mutex> lock(m);
+        auto old = byStation.find(stationId);
+        if (old != byStation.end()) {
+            for (int id : old->second) {
+                byStationParam.erase(key(stationId, byId[id].param));
+                byId.erase(id);
+            }
+            byStation.erase(old);
+        }
+        byStation[stationId]; // known even without sensors
+        for (const auto& info : list)
+            insert(info);
+    }
+
+    // {"sensors": [...], "emptyStations": [...]}; older files are just the sensor array
+    bool load(const string& filename) {
+        string content;
+        if (!storedFiles.read(filename, content) || content.empty())
+            return false;
+        try {
+            nlohmann::json registry = nlohmann::json::parse(content);
+            const nlohmann::json& sensors = registry.is_array() ? registry : registry["sensors"];
+            lock_guard<mutex> lock(m);
+            for (const auto& entry : sensors)
+                insert(sensorFromJson(entry));
+            if (registry.is_object() && registry.contains("emptyStations"))
+                for (const auto& id : registry["emptyStations"])
+                    byStation[id.get<int>()];
+        } catch (nlohmann::json::exception& e) {
+            LOG_ERROR("Could not read {}: {}", filename, e.what());
+            return false;
+        }
+        return true;
+    }
+
+    bool save(const string& filename) const {
+        nlohmann::json sensors = nlohmann::json::array();
+        vector<int> emptyStations;
         {
-            double x = leftMargin + maxIndex * scaleX;
-            double y = panelHeight - bottomMargin - (values[maxIndex] - minValue) * scaleY;
-            wxPen highlightPen(*wxRED_PEN);
-            highlightPen.SetWidth(2);
-            dc.SetPen(highlightPen);
-            dc.DrawCircle(wxPoint(x, y), 5);
-            wxString maxLabel;
-            maxLabel.Printf("Max: %.2f (%s)", values[maxIndex], wxString::FromUTF8(dates[maxIndex].c_str()));
-            dc.DrawText(maxLabel, x + 5, y - 10);
+            lock_guard<mutex> lock(m);
+            vector<int> ids;
+            for (const auto& [id, info] : byId)
+                ids.push_back(id);
+            sort(ids.begin(), ids.end());
+            for (int id : ids)
+                sensors.push_back(sensorToJson(byId.at(id)));
+            for (const auto& [stationId, list] : byStation)
+                if (list.empty())
+                    emptyStations.push_back(stationId);
+        }
+        sort(emptyStations.begin(), emptyStations.end());
+        nlohmann::json registry;
+        registry["sensors"] = move(sensors);
+        registry["emptyStations"] = emptyStations;
+        return storedFiles.write(filename, registry.dump(4));
+    }
+
+    // Downloads station/sensors for every station on a few threads in the
+    // background, then writes the registry to filename
+    void syncAll(const vector<int>& stationIds, const string& filename, int threads = 8) {
+        if (syncThread.joinable())
+            return;
+        stopping = false;
+        syncThread = thread([this, stationIds, filename, threads] {
+            TraceSpan span("SensorRegistry::syncAll");
+            atomic<size_t> next{0}, failed{0};
+            vector<thread> workers;
+            for (int t = 0; t < threads; ++t) {
+                workers.emplace_back([&] {
+                    CURL* curl = curl_easy_init();
+                    if (!curl)
+                        return;
+                    for (size_t i; !stopping && (i = next++) < stationIds.size();) {
+                        string response;
+                        string url = apiUrl("station/sensors/" + to_string(stationIds[i]));
+                        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+                        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+                        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+                        try {
+                            if (curl_easy_perform(curl) != CURLE_OK)
+                                throw runtime_error(url);
+                            setStation(stationIds[i], nlohmann::json::parse(response));
+                        } catch (exception& e) {
+                            ++failed;
+                        }
+                    }
+                    curl_easy_cleanup(curl);
+                });
+            }
+            for (auto& w : workers)
+                w.join();
+            if (stopping)
+                return;
+            save(filename);
+            LOG_INFO("Sensor registry: {} sensors at {} stations, {} downloads failed", size(), stationIds.size(), failed.load());
+        });
+    }
+
+    void stop() {
+        stopping = true;
+        if (syncThread.joinable())
+            syncThread.join();
+    }
+
+private:
+    mutable mutex m;
+    unordered_map<int, SensorInfo> byId;
+    unordered_map<int64_t, int> byStationParam;
+    unordered_map<int, vector<int>> byStation;
+    thread syncThread;
+    atomic<bool> stopping{false};
+
+    static int64_t key(int stationId, Param param) { return static_cast<int64_t>(stationId) << 8 | static_cast<int64_t>(param); }
+
+    void insert(const SensorInfo& info) {
+        auto [it, added] = byId.insert({info.id, info});
+        if (!added)
+            return;
+        byStation[info.stationId].push_back(info.id);
+        if (info.param != Param::Count)
+            byStationParam[key(info.stationId, info.param)] = info.id;
+    }
+};
+
+SensorRegistry sensorRegistry;
+
+// Time-major copy of the hourly values: per parameter and UTC month one
+// file of rows, a row per hour holding that hour's value of every sensor of
+// the parameter (float, NaN = missing), so all stations at hour T are one
+// contiguous read. "<code>.columns" lists the sensor ids in column order and
+// only grows; a month file that runs out of columns is rewritten wider.
+// Filled at ingest from fetchAndSaveSensorData. Needs pread/pwrite, on
+// other platforms the index stays empty and its users find no data.
+#ifdef __unix__
+class CrossSectionIndex {
+public:
+    explicit CrossSectionIndex(const string& directory) : dir(directory) {}
+
+    // values: (UTC time, value) pairs of one sensor; times off the hour are skipped
+    void record(Param param, int sensorId, const vector<pair<int64_t, double>>& values) {
+        if (param == Param::Count || values.empty())
+            return;
+        lock_guard<mutex> lock(m);
+        size_t column = columnOf(param, sensorId);
+        MonthFile file;
+        for (const auto& [t, value] : values) {
+            if (floorDiv(t, 3600) * 3600 != t)
+                continue;
+            int64_t month = monthStart(t);
+            if (file.fd < 0 || file.firstHour != month) {
+                file.close();
+                if (!openMonth(param, month, column + 1, file))
+                    continue;
+            }
+            float v = static_cast<float>(value);
+            off_t at = kHeaderSize + ((t - file.firstHour) / 3600 * file.capacity + column) * sizeof(float);
+            if (pwrite(file.fd, &v, sizeof(v), at) != sizeof(v))
+                LOG_ERROR("Cross-section write failed for sensor {}", sensorId);
+        }
+    }
+
+    // Every sensor of param at the hour starting at hourUtc, columns in the
+    // same order as sensorIds; false when nothing was recorded for that month
+    bool snapshot(Param param, int64_t hourUtc, vector<int>& sensorIds, vector<float>& values) {
+        lock_guard<mutex> lock(m);
+        sensorIds = columns(param);
+        values.assign(sensorIds.size(), NAN);
+        MonthFile file;
+        if (!openMonth(param, monthStart(hourUtc), 0, file))
+            return false;
+        off_t at = kHeaderSize + (floorDiv(hourUtc - file.firstHour, 3600) * file.capacity) * sizeof(float);
+        size_t width = min<size_t>(values.size(), file.capacity);
+        return pread(file.fd, values.data(), width * sizeof(float), at) == static_cast<ssize_t>(width * sizeof(float));
+    }
+
+    // hours consecutive rows from fromHour on, one read per month:
+    // rows[h * sensorIds.size() + column], NaN where nothing was recorded
+    void snapshotRange(Param param, int64_t fromHour, size_t hours, vector<int>& sensorIds, vector<float>& rows) {
+        lock_guard<mutex> lock(m);
+        sensorIds = columns(param);
+        size_t width = sensorIds.size();
+        rows.assign(hours * width, NAN);
+        vector<float> buffer;
+        for (size_t h = 0; h < hours;) {
+            int64_t hour = fromHour + static_cast<int64_t>(h) * 3600;
+            int64_t month = monthStart(hour);
+            size_t inMonth = min<size_t>(hours - h, hoursInMonth(month) - (hour - month) / 3600);
+            MonthFile file;
+            if (openMonth(param, month, 0, file)) {
+                buffer.resize(inMonth * file.capacity);
+                off_t at = kHeaderSize + ((hour - month) / 3600 * file.capacity) * sizeof(float);
+                ssize_t got = pread(file.fd, buffer.data(), buffer.size() * sizeof(float), at);
+                size_t complete = got > 0 ? static_cast<size_t>(got) / sizeof(float) / file.capacity : 0;
+                for (size_t r = 0; r < complete; ++r)
+                    copy_n(buffer.begin() + r * file.capacity, min<size_t>(width, file.capacity), rows.begin() + (h + r) * width);
+            }
+            h += inMonth;
+        }
+    }
+
+private:
+    static constexpr uint32_t kMagic = 0x4A505853; // "JPXS"
+    static constexpr off_t kHeaderSize = 16;       // magic, capacity, first hour
+
+    struct MonthFile {
+        int fd = -1;
+        uint32_t capacity = 0;
+        int64_t firstHour = 0;
+        ~MonthFile() { close(); }
+        void close() {
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+        }
+    };
+
+    string dir;
+    mutex m;
+    array<vector<int>, kParamCount> columnIds;
+    array<unordered_map<int, size_t>, kParamCount> columnById;
+    array<bool, kParamCount> columnsLoaded{};
+
+    string path(Param param, const string& suffix) const { return dir + "/" + string(kParamCodes[paramIndex(param)]) + suffix; }
+
+    static int64_t monthStart(int64_t t) {
+        string date = formatTimestamp(t);
+        return daysFromCivil(stoi(date.substr(0, 4)), stoi(date.substr(5, 2)), 1) * 86400;
+    }
+
+    static int64_t hoursInMonth(int64_t firstHour) {
+        string date = formatTimestamp(firstHour);
+        int year = stoi(date.substr(0, 4)), month = stoi(date.substr(5, 2));
+        int64_t next = month == 12 ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, month + 1, 1);
+        return next * 24 - firstHour / 3600;
+    }
+
+    const vector<int>& columns(Param param) {
+        size_t p = paramIndex(param);
+        if (!columnsLoaded[p]) {
+            columnsLoaded[p] = true;
+            ifstream in(path(param, ".columns"));
+            for (int id; in >> id;) {
+                columnById[p][id] = columnIds[p].size();
+                columnIds[p].push_back(id);
+            }
+        }
+        return columnIds[p];
+    }
+
+    size_t columnOf(Param param, int sensorId) {
+        size_t p = paramIndex(param);
+        columns(param);
+        auto it = columnById[p].find(sensorId);
+        if (it != columnById[p].end())
+            return it->second;
+        mkdir(dir.c_str(), 0755);
+        ofstream(path(param, ".columns"), ios::app) << sensorId << "\n";
+        columnById[p][sensorId] = columnIds[p].size();
+        columnIds[p].push_back(sensorId);
+        return columnIds[p].size() - 1;
+    }
+
+    // minColumns == 0 only opens an existing file
+    bool openMonth(Param param, int64_t firstHour, size_t minColumns, MonthFile& file) {
+        string name = path(param, "-" + formatTimestamp(firstHour).substr(0, 7) + ".bin");
+        file.fd = ::open(name.c_str(), O_RDWR);
+        if (file.fd >= 0) {
+            uint32_t header[2];
+            if (pread(file.fd, header, sizeof(header), 0) != sizeof(header) || header[0] != kMagic) {
+                LOG_ERROR("{} is not a cross-section file", name);
+                file.close();
+                return false;
+            }
+            file.capacity = header[1];
+            file.firstHour = firstHour;
+            if (minColumns <= file.capacity)
+                return true;
+            file.close();
+            return widen(name, firstHour, minColumns, file);
+        }
+        if (minColumns == 0)
+            return false;
+        mkdir(dir.c_str(), 0755);
+        return create(name, firstHour, capacityFor(minColumns), nullptr, file);
+    }
+
+    static uint32_t capacityFor(size_t columns) {
+        uint32_t capacity = 256;
+        while (capacity < columns)
+            capacity *= 2;
+        return capacity;
+    }
+
+    // Writes a NaN-filled month under a temp name, copies old rows in and renames
+    bool create(const string& name, int64_t firstHour, uint32_t capacity, const MonthFile* old, MonthFile& file) {
+        string temp = name + ".tmp";
+        int fd = ::open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        uint32_t header[4] = {kMagic, capacity, 0, 0};
+        memcpy(&header[2], &firstHour, sizeof(firstHour));
+        bool ok = pwrite(fd, header, sizeof(header), 0) == sizeof(header);
+        vector<float> row(capacity, NAN), oldRow(old ? old->capacity : 0);
+        int64_t hours = hoursInMonth(firstHour);
+        for (int64_t h = 0; ok && h < hours; ++h) {
+            if (old) {
+                ok = pread(old->fd, oldRow.data(), oldRow.size() * sizeof(float), kHeaderSize + h * oldRow.size() * sizeof(float)) ==
+                     static_cast<ssize_t>(oldRow.size() * sizeof(float));
+                copy(oldRow.begin(), oldRow.end(), row.begin());
+            }
+            ok = ok && pwrite(fd, row.data(), row.size() * sizeof(float), kHeaderSize + h * row.size() * sizeof(float)) ==
+                           static_cast<ssize_t>(row.size() * sizeof(float));
+        }
+        if (!ok || rename(temp.c_str(), name.c_str()) != 0) {
+            ::close(fd);
+            unlink(temp.c_str());
+            LOG_ERROR("Could not create {}", name);
+            return false;
+        }
+        file.fd = fd;
+        file.capacity = capacity;
+        file.firstHour = firstHour;
+        return true;
+    }
+
+    bool widen(const string& name, int64_t firstHour, size_t minColumns, MonthFile& file) {
+        MonthFile old;
+        old.fd = ::open(name.c_str(), O_RDONLY);
+        uint32_t header[2];
+        if (old.fd < 0 || pread(old.fd, header, sizeof(header), 0) != sizeof(header))
+            return false;
+        old.capacity = header[1];
+        old.firstHour = firstHour;
+        return create(name, firstHour, capacityFor(minColumns), &old, file);
+    }
+};
+#else
+class CrossSectionIndex {
+public:
+    explicit CrossSectionIndex(const string&) {}
+
+    void record(Param, int, const vector<pair<int64_t, double>>&) {}
+
+    bool snapshot(Param, int64_t, vector<int>& sensorIds, vector<float>& values) {
+        sensorIds.clear();
+        values.clear();
+        return false;
+    }
+
+    void snapshotRange(Param, int64_t, size_t, vector<int>& sensorIds, vector<float>& rows) {
+        sensorIds.clear();
+        rows.clear();
+    }
+};
+#endif
+
+CrossSectionIndex crossSection("xsection");
+
+// Per-sensor mean over the last `hours` whole hours, kept up to date as
+// values merge in (a ring of the window's hours with a running sum/count,
+// expired hours subtracted lazily), and a top-K query over those means that
+// only holds K candidates in a heap. A station with two sensors of one
+// parameter is ranked once, by the worse of them. A parameter is seeded from
+// the cross-section index the first time it is queried.
+class WindowTopK {
+public:
+    struct Ranked {
+        int stationId;
+        int sensorId;
+        double mean;
+        int hours; // valid hours in the window
+    };
+
+    explicit WindowTopK(int windowHours = 24, int minimumHours = 18) : hours(windowHours), minHours(minimumHours) {}
+
+    void add(Param param, int sensorId, int stationId, const vector<pair<int64_t, double>>& values) {
+        if (param == Param::Count)
+            return;
+        lock_guard<mutex> lock(m);
+        Window& w = windows[paramIndex(param)][sensorId];
+        w.stationId = stationId;
+        for (const auto& [t, value] : values)
+            put(w, floorDiv(t, 3600), value);
+    }
+
+    // The k stations with the highest sensor mean over the window ending
+    // with the hour that contains nowUtc; sensors with fewer than minHours
+    // valid hours are left out
+    vector<Ranked> top(Param param, size_t k, int64_t nowUtc) {
+        if (param == Param::Count || k == 0)
+            return {};
+        lock_guard<mutex> lock(m);
+        int64_t nowHour = floorDiv(nowUtc, 3600);
+        seed(param, nowHour);
+        unordered_map<int, Ranked> byStation; // sensors without a known station stand alone
+        for (auto& [sensorId, w] : windows[paramIndex(param)]) {
+            expire(w, nowHour);
+            if (w.count < minHours)
+                continue;
+            Ranked r{w.stationId, sensorId, w.sum / w.count, w.count};
+            auto [it, added] = byStation.try_emplace(w.stationId ? w.stationId : -sensorId, r);
+            if (!added && r.mean > it->second.mean)
+                it->second = r;
         }
-    
-        // Calculate average
-        double sum = accumulate(values.begin(), values.end(), 0.0);
-        double avg = (values.empty() ? 0 : sum / values.size());
+        auto worse = [](const Ranked& a, const Ranked& b) { return a.mean > b.mean; };
+        vector<Ranked> heap; // min-heap on mean, the weakest of the best k on top
+        for (const auto& [key, r] : byStation) {
+            if (heap.size() < k) {
+                heap.push_back(r);
+                push_heap(heap.begin(), heap.end(), worse);
+            } else if (r.mean > heap.front().mean) {
+                pop_heap(heap.begin(), heap.end(), worse);
+                heap.back() = r;
+                push_heap(heap.begin(), heap.end(), worse);
+            }
+        }
+        sort_heap(heap.begin(), heap.end(), worse);
+        return heap;
+    }
 
-        // Optionally, display the current (most recent) sensor value near the X-axis.
-        wxString currentValueStr;
-        wxString printMin;
-        wxString printMax;
-        wxString avgStr;
-        wxString printTrend;
+private:
+    struct Slot {
+        int64_t hour = numeric_limits<int64_t>::min();
+        double value = 0;
+    };
+    struct Window {
+        int stationId = 0;
+        vector<Slot> slots; // slot of hour h is h % size
+        double sum = 0;
+        int count = 0;
+        int64_t newest = numeric_limits<int64_t>::min();
+    };
 
-        currentValueStr.Printf("Current Value: %.2f", values.back());
-        printMin.Printf("Min: %.2f (%s)", values[minIndex], wxString::FromUTF8(dates[minIndex].c_str()));
-        printMax.Printf("Max: %.2f (%s)", values[maxIndex], wxString::FromUTF8(dates[maxIndex].c_str()));
-        avgStr.Printf("Average Value: %.2f", avg);
-        printTrend.Printf("Trend: %s", CalculateTrend(values));
-        wxFont currentValueFont(10, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_BOLD);
-        dc.SetFont(currentValueFont);
-        dc.SetPen(*wxBLACK_PEN);
-        dc.DrawText(currentValueStr, leftMargin, panelHeight - 40);
-        dc.DrawText(printMin, leftMargin+175, panelHeight - 40);
-        dc.DrawText(printMax, leftMargin+425, panelHeight - 40);
-        dc.DrawText(avgStr, leftMargin, panelHeight - 20);
-        dc.DrawText(printTrend, leftMargin + 175, panelHeight - 20);
+    int hours;
+    int minHours;
+    mutex m;
+    array<unordered_map<int, Window>, kParamCount> windows;
+    array<bool, kParamCount> seeded{};
+
+    void put(Window& w, int64_t hour, double value) {
+        if (w.slots.empty())
+            w.slots.resize(hours);
+        if (w.count > 0 && hour <= w.newest - hours)
+            return; // already outside the window
+        if (w.count == 0 || hour > w.newest) {
+            expire(w, hour);
+            w.newest = hour;
+        }
+        Slot& slot = w.slots[static_cast<size_t>((hour % hours + hours) % hours)];
+        if (slot.hour != numeric_limits<int64_t>::min()) {
+            w.sum -= slot.value;
+            --w.count;
+        }
+        slot = {hour, value};
+        w.sum += value;
+        ++w.count;
     }
-    
-    string CalculateTrend(const vector<double>& values) {
-        if (values.size() < 2) {
-            return "Not enough data";
+
+    // Drops hours that are no longer in the window ending at nowHour
+    void expire(Window& w, int64_t nowHour) {
+        if (w.count == 0 || nowHour <= w.newest)
+            return;
+        for (Slot& slot : w.slots) {
+            if (slot.hour != numeric_limits<int64_t>::min() && slot.hour <= nowHour - hours) {
+                w.sum -= slot.value;
+                --w.count;
+                slot.hour = numeric_limits<int64_t>::min();
+            }
         }
-        
-        size_t n = values.size();
-        double sumX = 0;
-        double sumY = 0;
-        double sumXY = 0;
-        double sumX2 = 0;
-        
-        // Use index as the x-coordinate
-        for (size_t i = 0; i < n; ++i) {
-            double x = static_cast<double>(i);
-            double y = values[i];
-            sumX += x;
-            sumY += y;
-            sumXY += x * y;
-            sumX2 += x * x;
+    }
+
+    void seed(Param param, int64_t nowHour) {
+        if (seeded[paramIndex(param)])
+            return;
+        seeded[paramIndex(param)] = true;
+        unordered_map<int, Window>& byParam = windows[paramIndex(param)];
+        vector<int> sensorIds;
+        vector<float> values;
+        for (int64_t hour = nowHour - hours + 1; hour <= nowHour; ++hour) {
+            if (!crossSection.snapshot(param, hour * 3600, sensorIds, values))
+                continue;
+            for (size_t i = 0; i < sensorIds.size(); ++i) {
+                if (isnan(values[i]))
+                    continue;
+                Window& w = byParam[sensorIds[i]];
+                SensorInfo info;
+                if (w.stationId == 0 && sensorRegistry.find(sensorIds[i], info))
+                    w.stationId = info.stationId;
+                put(w, hour, values[i]);
+            }
         }
-        
-        // Calculate slope using the formula:
-        // slope = (n*sumXY - sumX*sumY) / (n*sumX2 - (sumX)^2)
-        double denominator = n * sumX2 - sumX * sumX;
-        if (denominator == 0) {
-            return "Undefined trend";
-        }
-        double slope = (n * sumXY - sumX * sumY) / denominator;
-        double slopdeg=0.1763;
-        if (slope > slopdeg) {
-            return "Rising";
-        } else if (slope < -slopdeg) {
-            return "Falling";
+    }
+};
+
+WindowTopK worstStations;
+
+// Hours that got new values since the outlier check last looked at them.
+// Late values for an hour that was already checked put it back in, so the
+// hourly check sees every hour again once its data has changed.
+class OutlierBacklog {
+public:
+    void add(Param param, const vector<pair<int64_t, double>>& hourly) {
+        if (param == Param::Count)
+            return;
+        lock_guard<mutex> lock(m);
+        for (const auto& [t, v] : hourly)
+            pending[paramIndex(param)].insert(floorDiv(t, 3600) * 3600);
+    }
+
+    // Removes and returns the queued hours up to lastHour
+    vector<int64_t> take(size_t p, int64_t lastHour) {
+        lock_guard<mutex> lock(m);
+        set<int64_t>& queued = pending[p];
+        auto end = queued.upper_bound(lastHour);
+        vector<int64_t> ready(queued.begin(), end);
+        queued.erase(queued.begin(), end);
+        return ready;
+    }
+
+private:
+    mutex m;
+    array<set<int64_t>, kParamCount> pending;
+};
+
+OutlierBacklog outlierBacklog;
+
+// Data quality of one sensor over the last days of its stored history:
+// how much of it is there, how long it went silent, how much looks stuck or
+// implausible and how old the newest value is. Worked out in one pass over
+// the columns of the sensor's Series.
+constexpr size_t kFlatRunHours = 6; // this many identical hours in a row = stuck sensor
+
+struct SensorQuality {
+    size_t hours = 0;        // present values in the window
+    double coverage = 0;     // present / hours in the window up to now
+    int64_t longestGap = 0;  // hours without a value between two present ones
+    size_t flatHours = 0;    // hours inside flat-line runs
+    size_t spikes = 0;       // values far above both neighbours
+    int64_t latency = 0;     // seconds from the newest value to the scoring (= ingest) time
+    int score = 0;           // 0-100
+};
+
+SensorQuality scoreSeries(const Series& series, int64_t now, int64_t windowDays = 30) {
+    SensorQuality q;
+    size_t begin = lower_bound(series.time.begin(), series.time.end(), now - windowDays * 86400) - series.time.begin();
+    int64_t last = 0;
+    double sum = 0, previous = NAN, beforePrevious = NAN;
+    size_t run = 0;
+    for (size_t i = begin; i < series.size(); ++i) {
+        if (!series.isValid(i))
+            continue;
+        double v = series.value[i];
+        int64_t t = series.time[i];
+        if (q.hours == 0) {
+            run = 1;
         } else {
-            return "Stable";
+            q.longestGap = max(q.longestGap, (t - last) / 3600 - 1);
+            if (v == previous && t - last == 3600) {
+                ++run;
+            } else {
+                if (run >= kFlatRunHours)
+                    q.flatHours += run;
+                run = 1;
+            }
+            // The previous value is a spike when it sticks far out of both
+            // neighbours and of the mean so far
+            double around = max(beforePrevious, v);
+            if (!isnan(beforePrevious) && previous > 3 * around && previous - around > 3 * sum / q.hours)
+                ++q.spikes;
+        }
+        beforePrevious = previous;
+        previous = v;
+        last = t;
+        sum += v;
+        ++q.hours;
+    }
+    if (q.hours == 0)
+        return q;
+    if (run >= kFlatRunHours)
+        q.flatHours += run;
+    // Over the whole window up to now, so hours missing at either end count
+    // too; a sensor whose stored history is younger than the window is
+    // measured from its first stored hour
+    int64_t from = max(now - windowDays * 86400, series.time.front());
+    q.coverage = min(1.0, static_cast<double>(q.hours) / (floorDiv(now - from, 3600) + 1));
+    q.latency = max<int64_t>(0, now - last);
+    double score = 100 * q.coverage;
+    score -= 100.0 * q.flatHours / q.hours;
+    score -= 2.0 * min<size_t>(q.spikes, 10);
+    score -= clamp(q.latency / 3600.0 - 6, 0.0, 30.0); // GIOŚ values normally lag a few hours
+    q.score = clamp(static_cast<int>(lround(score)), 0, 100);
+    return q;
+}
+
+// Scores of every sensor with stored data. A background pass scores all the
+// station files in parallel at startup; after that the same thread rescores
+// the sensors ingest queues up, reading their station file again, so the
+// whole-history pass stays off the GUI thread.
+class DataQuality {
+public:
+    ~DataQuality() { stop(); }
+
+    bool find(int sensorId, SensorQuality& q) const {
+        lock_guard<mutex> lock(m);
+        auto it = bySensor.find(sensorId);
+        if (it == bySensor.end())
+            return false;
+        q = it->second;
+        return true;
+    }
+
+    // replace = false keeps a score that is already there: the startup pass
+    // may have read a station file before an ingest rewrote and rescored it
+    void scoreSensor(const nlohmann::json& sensor, int64_t now, bool replace = true) {
+        if (!sensor.contains("id") || !sensor.contains("values"))
+            return;
+        SensorQuality q = scoreSeries(seriesFromJson(sensor), now);
+        lock_guard<mutex> lock(m);
+        if (replace)
+            bySensor[sensor["id"].get<int>()] = q;
+        else
+            bySensor.try_emplace(sensor["id"].get<int>(), q);
+    }
+
+    void scoreStation(const nlohmann::json& stationData, int64_t now, bool replace = true) {
+        for (const auto& sensor : stationData)
+            scoreSensor(sensor, now, replace);
+    }
+
+    // Rescores the sensor on the background thread; repeated requests before
+    // it gets there are merged
+    void requestScore(int stationId, int sensorId) {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            queued.insert({stationId, sensorId});
+        }
+        wake.notify_one();
+    }
+
+    void start(const vector<int>& stationIds, int threads = 4) {
+        if (worker.joinable())
+            return;
+        stopping = false;
+        worker = thread([this, stationIds, threads] {
+            TraceSpan span("DataQuality::start");
+            lowerThreadPriority();
+            int64_t now = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+            atomic<size_t> next{0}, scored{0};
+            auto work = [&] {
+                for (size_t i; !stopping && (i = next++) < stationIds.size();) {
+                    string content;
+                    if (!storedFiles.read(to_string(stationIds[i]) + ".json", content) || content.empty())
+                        continue;
+                    try {
+                        scoreStation(nlohmann::json::parse(content), now, false);
+                        ++scored;
+                    } catch (nlohmann::json::exception& e) {
+                        LOG_WARN("No quality scores for station {}: {}", stationIds[i], e.what());
+                    }
+                }
+            };
+            vector<thread> pool;
+            for (int t = 1; t < threads; ++t)
+                pool.emplace_back(work);
+            work();
+            for (auto& t : pool)
+                t.join();
+            LOG_INFO("Data quality: {} station files scored", scored.load());
+            rescoreQueued();
+        });
+    }
+
+    void stop() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable())
+            worker.join();
+    }
+
+private:
+    mutable mutex m;
+    unordered_map<int, SensorQuality> bySensor;
+    thread worker;
+    atomic<bool> stopping{false};
+    mutex queueMutex;
+    condition_variable wake;
+    set<pair<int, int>> queued; // (station, sensor)
+
+    void rescoreQueued() {
+        while (true) {
+            set<pair<int, int>> batch;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                wake.wait(lock, [this] { return stopping || !queued.empty(); });
+                if (stopping)
+                    return;
+                batch.swap(queued);
+            }
+            int64_t now = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+            for (auto it = batch.begin(); it != batch.end() && !stopping;) {
+                int stationId = it->first;
+                string content;
+                try {
+                    nlohmann::json stationData;
+                    if (storedFiles.read(to_string(stationId) + ".json", content) && !content.empty())
+                        stationData = nlohmann::json::parse(content);
+                    for (; it != batch.end() && it->first == stationId; ++it)
+                        for (const auto& sensor : stationData)
+                            if (sensor.contains("id") && sensor["id"] == it->second)
+                                scoreSensor(sensor, now);
+                } catch (nlohmann::json::exception& e) {
+                    LOG_WARN("No quality scores for station {}: {}", stationId, e.what());
+                    while (it != batch.end() && it->first == stationId)
+                        ++it;
+                }
+            }
         }
     }
 };
 
+DataQuality dataQuality;
 
-size_t WriteCallback(void* contents, size_t size, size_t nmemb, string* output) {
-    size_t totalSize = size * nmemb;
-    output->append((char*)contents, totalSize);
-    return totalSize;
+// Appends the values whose UTC time the sensor doesn't have yet to its
+// entry in stationData (creating the entry if needed) and returns them.
+// param is filled from the stored sensor when the response didn't name it.
+vector<nlohmann::json> mergeSensorValues(nlohmann::json& stationData, int sensorID, const nlohmann::json& newValues,
+                                         const vector<int64_t>& newTimes, Param& param) {
+    // Look for sensor data with the specified sensorID.
+    bool sensorFound = false;
+    vector<nlohmann::json> added; // values this merge appended
+    for (auto& sensor : stationData) {
+        if (sensor["id"] == sensorID) {
+            sensorFound = true;
+            if (param == Param::Count && sensor.contains("param"))
+                param = paramFromCode(sensor["param"].value("paramCode", ""));
+            if (!sensor.contains("values"))
+                sensor["values"] = nlohmann::json::array();
+            // Files written before "t" existed get it now
+            nlohmann::json& values = sensor["values"];
+            vector<int64_t> existingTimes = batchTimesUtc(values);
+            unordered_set<int64_t> known;
+            for (size_t i = 0; i < values.size(); ++i) {
+                if (existingTimes[i] == numeric_limits<int64_t>::min())
+                    continue;
+                values[i]["t"] = existingTimes[i];
+                known.insert(existingTimes[i]);
+            }
+            // Append new values whose UTC time isn't stored yet.
+            for (size_t i = 0; i < newValues.size(); ++i) {
+                if (newTimes[i] == numeric_limits<int64_t>::min() || !known.insert(newTimes[i]).second)
+                    continue;
+                values.push_back(newValues[i]);
+                added.push_back(newValues[i]);
+            }
+            break;
+        }
+    }
+
+    // If no sensor with sensorID is found, add a new sensor entry.
+    if (!sensorFound) {
+        nlohmann::json newEntry;
+        newEntry["id"] = sensorID;
+        newEntry["values"] = newValues;
+        stationData.push_back(newEntry);
+        added.assign(newValues.begin(), newValues.end());
+    }
+    return added;
 }
 
-void fetchAndSaveData(const string& url, const string& filename) {
+void fetchAndSaveSensorData(int stationID, int sensorID) {
+    TraceSpan span("fetchAndSaveSensorData");
     CURL* curl;
     CURLcode result;
     string responseString;
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+    // libcurl's global state is set up once in MyApp::OnInit
     curl = curl_easy_init();
 
     if (curl) {
+        string url = apiUrl("data/getData/" + to_string(sensorID));
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseString);
@@ -263,170 +4438,934 @@ void fetchAndSaveData(const string& url, const string& filename) {
 
         if (result == CURLE_OK) {
             try {
-                nlohmann::json jsonData = nlohmann::json::parse(responseString);
-                ofstream file(filename);
-                if (file.is_open()) {
-                    file << jsonData.dump(4);
-                    file.close();
+                nlohmann::json newSensorData = nlohmann::json::parse(responseString);
+                
+                string filename = to_string(stationID) + ".json";
+                unique_lock<recursive_mutex> lock(storedFileMutex(filename));
+                nlohmann::json stationData;
+                string content;
+                if (storedFiles.read(filename, content)) {
+                    stationData = nlohmann::json::parse(content);
+                } else {
+                    // Create an empty JSON array if the file doesn't exist.
+                    stationData = nlohmann::json::array();
+                }
+
+                // Every value gets its UTC time "t" next to the GIOŚ date,
+                // so the two 02:00 hours in October are different samples.
+                // The stored values settle a 02:00 whose twin came in an
+                // earlier fetch.
+                auto isStored = [&](int64_t t) {
+                    for (const auto& sensor : stationData) {
+                        if (sensor["id"] != sensorID || !sensor.contains("values"))
+                            continue;
+                        for (const auto& entry : sensor["values"]) {
+                            int64_t stored;
+                            if (entryUtc(entry, stored) && stored == t)
+                                return true;
+                        }
+                    }
+                    return false;
+                };
+                nlohmann::json& newValues = newSensorData["values"];
+                vector<int64_t> newTimes = batchTimesUtc(newValues, isStored);
+                for (size_t i = 0; i < newValues.size(); ++i) {
+                    if (newTimes[i] != numeric_limits<int64_t>::min())
+                        newValues[i]["t"] = newTimes[i];
                 }
+
+                Param param = paramFromCode(newSensorData.value("key", ""));
+                SensorInfo info;
+                if (param == Param::Count && sensorRegistry.find(sensorID, info))
+                    param = info.param;
+                vector<nlohmann::json> added = mergeSensorValues(stationData, sensorID, newValues, newTimes, param);
+
+                if (!storedFiles.write(filename, stationData.dump(4)))
+                    LOG_ERROR("Could not write {}", filename);
+                lock.unlock();
+                ++stationDataVersion[stationID];
+                dataQuality.requestScore(stationID, sensorID);
+                vector<pair<int64_t, double>> hourly;
+                for (const auto& entry : added)
+                    if (entry.contains("t") && entry.contains("value") && entry["value"].is_number())
+                        hourly.push_back({entry["t"].get<int64_t>(), entry["value"].get<double>()});
+                crossSection.record(param, sensorID, hourly);
+                outlierBacklog.add(param, hourly);
+                worstStations.add(param, sensorID, stationID, hourly);
+                LOG_DEBUG("merged {} new values into sensor {} of station {}", added.size(), sensorID, stationID);
+                publishLatestValue(stationID, sensorID, newSensorData);
+                evaluateAlerts(stationID, sensorID, param, added);
             } catch (nlohmann::json::parse_error& e) {
-                cerr << "JSON Parsing Error: " << e.what() << endl;
+                LOG_ERROR("JSON parsing error for sensor {}: {}", sensorID, e.what());
+            }
+        }
+
+        curl_easy_cleanup(curl);
+    }
+}
+
+
+
+// Retention for station files: hourly values stay raw for rawDays, older
+// whole local days are rolled up into the sensor's "daily" array as
+// {date, t, count, mean, min, max, p50, p95} over the day's valid values.
+// Values are kept sorted newest first (the API order) without duplicates.
+struct RetentionPolicy {
+    int64_t rawDays = 730;
+};
+
+nlohmann::json rollupDay(int64_t localDay, vector<double>& valid) {
+    nlohmann::json day;
+    day["date"] = formatTimestamp(localDay * 86400).substr(0, 10);
+    day["t"] = warsawTime.localToUtc(localDay * 86400);
+    day["count"] = valid.size();
+    day["mean"] = accumulate(valid.begin(), valid.end(), 0.0) / valid.size();
+    auto [lo, hi] = minmax_element(valid.begin(), valid.end());
+    day["min"] = *lo;
+    day["max"] = *hi;
+    for (auto [key, q] : {pair<const char*, double>{"p50", 0.5}, {"p95", 0.95}}) {
+        auto nth = valid.begin() + static_cast<size_t>(q * (valid.size() - 1) + 0.5);
+        nth_element(valid.begin(), nth, valid.end());
+        day[key] = *nth;
+    }
+    return day;
+}
+
+// Returns true when stationData was changed
+bool compactStation(nlohmann::json& stationData, int64_t now, const RetentionPolicy& policy) {
+    bool changed = false;
+    int64_t cutoffDay = floorDiv(warsawTime.utcToLocal(now), 86400) - policy.rawDays;
+    for (auto& sensor : stationData) {
+        if (!sensor.is_object() || !sensor.contains("values") || !sensor["values"].is_array())
+            continue;
+        nlohmann::json& values = sensor["values"];
+        vector<int64_t> times = batchTimesUtc(values);
+        vector<size_t> keep;
+        map<int64_t, vector<double>> expired; // local day -> valid values
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (times[i] == numeric_limits<int64_t>::min()) {
+                keep.push_back(i);
+                continue;
+            }
+            int64_t day = floorDiv(warsawTime.utcToLocal(times[i]), 86400);
+            if (day >= cutoffDay) {
+                keep.push_back(i);
+            } else {
+                const auto& entry = values[i];
+                if (entry.contains("value") && entry["value"].is_number())
+                    expired[day].push_back(entry["value"].get<double>());
+            }
+        }
+        // Newest first; of two values for one hour the non-null one wins
+        stable_sort(keep.begin(), keep.end(), [&](size_t a, size_t b) { return times[a] > times[b]; });
+        vector<size_t> unique;
+        for (size_t i : keep) {
+            if (!unique.empty() && times[i] != numeric_limits<int64_t>::min() && times[i] == times[unique.back()]) {
+                if (values[unique.back()].value("value", nlohmann::json()).is_null() && !values[i].value("value", nlohmann::json()).is_null())
+                    unique.back() = i;
+                continue;
+            }
+            unique.push_back(i);
+        }
+        bool inOrder = unique.size() == values.size();
+        for (size_t k = 0; inOrder && k < unique.size(); ++k)
+            inOrder = unique[k] == k;
+        if (inOrder)
+            continue;
+        changed = true;
+
+        nlohmann::json compacted = nlohmann::json::array();
+        for (size_t i : unique) {
+            if (times[i] != numeric_limits<int64_t>::min())
+                values[i]["t"] = times[i];
+            compacted.push_back(move(values[i]));
+        }
+        values = move(compacted);
+
+        if (expired.empty())
+            continue;
+        // A day rolled up before (late values) keeps its quantiles, the rest is combined
+        map<int64_t, nlohmann::json> daily;
+        if (sensor.contains("daily"))
+            for (auto& day : sensor["daily"]) {
+                int64_t key = floorDiv(warsawTime.utcToLocal(day.value("t", int64_t(0))), 86400);
+                daily[key] = move(day);
+            }
+        for (auto& [day, valid] : expired) {
+            if (valid.empty())
+                continue;
+            nlohmann::json fresh = rollupDay(day, valid);
+            auto it = daily.find(day);
+            if (it == daily.end()) {
+                daily[day] = fresh;
+                continue;
+            }
+            nlohmann::json& old = it->second;
+            double count = old["count"].get<double>() + fresh["count"].get<double>();
+            old["mean"] = (old["mean"].get<double>() * old["count"].get<double>() + fresh["mean"].get<double>() * fresh["count"].get<double>()) / count;
+            old["min"] = min(old["min"].get<double>(), fresh["min"].get<double>());
+            old["max"] = max(old["max"].get<double>(), fresh["max"].get<double>());
+            old["count"] = static_cast<int64_t>(count);
+        }
+        nlohmann::json dailyArray = nlohmann::json::array();
+        for (auto it = daily.rbegin(); it != daily.rend(); ++it)
+            dailyArray.push_back(move(it->second));
+        sensor["daily"] = move(dailyArray);
+    }
+    return changed;
+}
+
+// Compacts station files ("<id>.json") in the background: once shortly
+// after start and then every few hours, skipping files it already compacted
+// that haven't been written since. A file written while it was being
+// compacted is left for the next pass rather than overwritten.
+class Compactor {
+public:
+    ~Compactor() { stop(); }
+
+    void start(const RetentionPolicy& retention) {
+        if (worker.joinable())
+            return;
+        policy = retention;
+        stopping = false;
+        worker = thread([this] {
+            lowerThreadPriority();
+            for (auto wait = chrono::seconds(30); !sleepFor(wait); wait = chrono::hours(6))
+                pass();
+        });
+    }
+
+    void stop() {
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable())
+            worker.join();
+    }
+
+private:
+    RetentionPolicy policy;
+    thread worker;
+    mutex wakeMutex;
+    condition_variable wake;
+    bool stopping = false;
+    unordered_map<string, int64_t> compactedMtime;
+
+    // true when stop() was called
+    bool sleepFor(chrono::steady_clock::duration d) {
+        unique_lock<mutex> lock(wakeMutex);
+        return wake.wait_for(lock, d, [this] { return stopping; });
+    }
+
+    // -1 when the file is gone
+    static int64_t mtimeOf(const string& filename) {
+        error_code error;
+        auto mtime = filesystem::last_write_time(filename, error);
+        return error ? -1 : static_cast<int64_t>(mtime.time_since_epoch().count());
+    }
+
+    void pass() {
+        TraceSpan span("Compactor::pass");
+        vector<string> names;
+        error_code error;
+        for (const auto& entry : filesystem::directory_iterator(".", error)) {
+            string name = entry.path().filename().string();
+            size_t digits = strspn(name.c_str(), "0123456789");
+            if (digits > 0 && name.substr(digits) == ".json")
+                names.push_back(name);
+        }
+
+        size_t rewritten = 0;
+        int64_t now = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+        for (const auto& name : names) {
+            if (sleepFor(chrono::milliseconds(20)))
+                return;
+            int64_t mtime = mtimeOf(name);
+            auto seen = compactedMtime.find(name);
+            if (mtime < 0 || (seen != compactedMtime.end() && seen->second == mtime))
+                continue;
+            string content;
+            nlohmann::json stationData;
+            try {
+                if (!storedFiles.read(name, content))
+                    continue;
+                stationData = nlohmann::json::parse(content);
+            } catch (nlohmann::json::exception& e) {
+                LOG_WARN("Compactor skipped {}: {}", name, e.what());
+                continue;
+            }
+            if (compactStation(stationData, now, policy)) {
+                lock_guard<recursive_mutex> lock(storedFileMutex(name));
+                if (mtimeOf(name) != mtime)
+                    continue;
+                storedFiles.write(name, stationData.dump(4));
+                ++rewritten;
+            }
+            compactedMtime[name] = mtimeOf(name);
+        }
+        LOG_INFO("Compaction: {} station files, {} rewritten", names.size(), rewritten);
+    }
+};
+
+Compactor compactor;
+
+// Spatial outliers: a sensor's value at one hour compared with the same
+// parameter at its k nearest stations. The score is a robust z-score,
+// (value - median) / (1.4826 * MAD), so one broken neighbour doesn't hide or
+// fake an anomaly; the MAD is floored at 1 unit so a flat neighbourhood
+// doesn't turn every small difference into one.
+struct OutlierFlag {
+    int stationId;
+    int sensorId;
+    int64_t hour; // UTC
+    double value;
+    double neighbourMedian;
+    double score;
+};
+
+vector<OutlierFlag> detectSpatialOutliers(Param param, int64_t hourUtc, size_t k = 6, double threshold = 5) {
+    TraceSpan span("detectSpatialOutliers");
+    vector<int> sensorIds;
+    vector<float> values;
+    if (!crossSection.snapshot(param, hourUtc, sensorIds, values))
+        return {};
+    struct Reading {
+        const Station* station;
+        int sensorId;
+        double value;
+    };
+    vector<Reading> readings;
+    unordered_map<int, double> valueAtStation;
+    for (size_t i = 0; i < sensorIds.size(); ++i) {
+        SensorInfo info;
+        if (isnan(values[i]) || !sensorRegistry.find(sensorIds[i], info))
+            continue;
+        if (const Station* st = catalog.byId(info.stationId)) {
+            readings.push_back({st, sensorIds[i], values[i]});
+            valueAtStation[st->id] = values[i];
+        }
+    }
+
+    // One hour is a few hundred stations; the caller spreads hours over threads
+    vector<OutlierFlag> flags;
+    vector<double> around, deviation;
+    for (const Reading& r : readings) {
+        auto neighbours = catalog.nearestK(r.station->lat, r.station->lon, k, [&](const Station& st) {
+            return st.id != r.station->id && valueAtStation.count(st.id);
+        });
+        if (neighbours.size() < 3)
+            continue;
+        around.clear();
+        for (const auto& n : neighbours)
+            around.push_back(valueAtStation.at(n.second->id));
+        nth_element(around.begin(), around.begin() + around.size() / 2, around.end());
+        double median = around[around.size() / 2];
+        deviation.clear();
+        for (double v : around)
+            deviation.push_back(fabs(v - median));
+        nth_element(deviation.begin(), deviation.begin() + deviation.size() / 2, deviation.end());
+        double mad = max(1.4826 * deviation[deviation.size() / 2], 1.0);
+        double score = (r.value - median) / mad;
+        if (score >= threshold)
+            flags.push_back({r.station->id, r.sensorId, hourUtc, r.value, median, score});
+    }
+    return flags;
+}
+
+// Writes "outlier": score into the flagged values of the station files
+void storeOutlierFlags(const vector<OutlierFlag>& flags) {
+    map<int, vector<const OutlierFlag*>> byStation;
+    for (const auto& flag : flags)
+        byStation[flag.stationId].push_back(&flag);
+    for (const auto& [stationId, list] : byStation) {
+        string filename = to_string(stationId) + ".json";
+        lock_guard<recursive_mutex> lock(storedFileMutex(filename));
+        string content;
+        nlohmann::json stationData;
+        try {
+            if (!storedFiles.read(filename, content))
+                continue;
+            stationData = nlohmann::json::parse(content);
+        } catch (nlohmann::json::exception& e) {
+            LOG_WARN("Outlier flags not stored for station {}: {}", stationId, e.what());
+            continue;
+        }
+        bool changed = false;
+        for (auto& sensor : stationData) {
+            if (!sensor.contains("values"))
+                continue;
+            for (const OutlierFlag* flag : list) {
+                if (sensor["id"] != flag->sensorId)
+                    continue;
+                for (auto& entry : sensor["values"]) {
+                    if (entry.value("t", int64_t(0)) == flag->hour) {
+                        entry["outlier"] = round(flag->score * 10) / 10;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        if (changed && storedFiles.write(filename, stationData.dump(4)))
+            ++stationDataVersion[stationId];
+        for (const OutlierFlag* flag : list)
+            LOG_INFO("Station {} sensor {}: {} vs neighbour median {} (score {})", stationId, flag->sensorId, flag->value,
+                     flag->neighbourMedian, flag->score);
+    }
+}
+
+// Groups of stations with a similar pollution profile (traffic, heating,
+// background...). A station is described by its history of one parameter:
+// the diurnal curve, the weekday curve, the seasonal means and two
+// percentiles, all divided by the station's mean so the groups are about
+// the shape of the pollution, not its level. k-means++ picks the seeds, then
+// Lloyd iterations run with the assignment step split over the cores.
+constexpr size_t kFeatureDims = 40; // 24 + 7 + 4 + 2 used, padded to a multiple of 8
+using FeatureVector = array<float, kFeatureDims>;
+constexpr size_t kMinProfileHours = 14 * 24;
+
+// Eight independent partial sums, so the loop vectorizes without -ffast-math
+inline float squaredDistance(const FeatureVector& a, const FeatureVector& b) {
+    float lanes[8] = {};
+    for (size_t i = 0; i < kFeatureDims; i += 8) {
+        for (size_t j = 0; j < 8; ++j) {
+            float d = a[i + j] - b[i + j];
+            lanes[j] += d * d;
+        }
+    }
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+// false when the series is too short (or all zero) to say anything
+bool profileFeatures(const Series& series, FeatureVector& f) {
+    vector<double> present;
+    for (size_t i = 0; i < series.size(); ++i)
+        if (series.isValid(i))
+            present.push_back(series.value[i]);
+    if (present.size() < kMinProfileHours)
+        return false;
+    double mean = accumulate(present.begin(), present.end(), 0.0) / present.size();
+    if (!(mean > 0))
+        return false;
+    Profile p = buildProfile(series.time.data(), series.value.data(), series.size());
+    auto scaled = [mean](double v) { return isnan(v) ? 1.0f : static_cast<float>(v / mean); };
+    f.fill(0);
+    for (int h = 0; h < 24; ++h)
+        f[h] = scaled(p.hourMean(kSeasonCount, h));
+    for (int d = 0; d < 7; ++d)
+        f[24 + d] = scaled(p.weekdayMean(kSeasonCount, d));
+    for (size_t s = 0; s < kSeasonCount; ++s) {
+        double sum = accumulate(p.hourSum[s].begin(), p.hourSum[s].end(), 0.0);
+        uint32_t count = accumulate(p.hourCount[s].begin(), p.hourCount[s].end(), 0u);
+        f[31 + s] = scaled(count ? sum / count : NAN);
+    }
+    nth_element(present.begin(), present.begin() + present.size() / 2, present.end());
+    f[35] = scaled(present[present.size() / 2]);
+    size_t p95 = present.size() * 95 / 100;
+    nth_element(present.begin(), present.begin() + p95, present.end());
+    f[36] = scaled(present[p95]);
+    return true;
+}
+
+struct KMeansResult {
+    vector<FeatureVector> centroids;
+    vector<int> assignment; // centroid index per point
+    double inertia = 0;     // sum of squared distances to the centroids
+    int iterations = 0;
+};
+
+KMeansResult kMeans(const vector<FeatureVector>& points, size_t k, int maxIterations = 100, uint64_t seed = 1) {
+    KMeansResult result;
+    size_t n = points.size();
+    if (n == 0 || k == 0)
+        return result;
+    mt19937_64 rng(seed);
+
+    // Greedy k-means++: draw a few candidates with probability proportional
+    // to their squared distance from the nearest seed so far and keep the one
+    // that lowers the total distance most (a single draw every now and then
+    // puts two seeds into one group)
+    vector<float> nearest(n, numeric_limits<float>::max());
+    double total = 0;
+    auto addSeed = [&](size_t seed) {
+        result.centroids.push_back(points[seed]);
+        total = 0;
+        for (size_t i = 0; i < n; ++i) {
+            nearest[i] = min(nearest[i], squaredDistance(points[i], points[seed]));
+            total += nearest[i];
+        }
+    };
+    addSeed(uniform_int_distribution<size_t>(0, n - 1)(rng));
+    const int candidates = 2 + static_cast<int>(log(static_cast<double>(k)));
+    while (result.centroids.size() < min(k, n) && total > 0) { // total 0 = fewer distinct points than k
+        size_t bestSeed = 0;
+        double bestTotal = numeric_limits<double>::max();
+        for (int c = 0; c < candidates; ++c) {
+            double pick = uniform_real_distribution<double>(0, total)(rng);
+            size_t seed = 0;
+            while (seed + 1 < n && (pick -= nearest[seed]) > 0)
+                ++seed;
+            double sum = 0;
+            for (size_t i = 0; i < n; ++i)
+                sum += min(nearest[i], squaredDistance(points[i], points[seed]));
+            if (sum < bestTotal) {
+                bestTotal = sum;
+                bestSeed = seed;
+            }
+        }
+        addSeed(bestSeed);
+    }
+    k = result.centroids.size();
+    result.assignment.assign(n, -1);
+
+    // Each thread takes a fixed range of points and keeps its own sums
+    struct Partial {
+        vector<array<double, kFeatureDims>> sum;
+        vector<size_t> count;
+        double inertia;
+        size_t changed;
+    };
+    size_t threads = min<size_t>(max(1u, thread::hardware_concurrency()), max<size_t>(1, n / 64));
+    vector<Partial> partial(threads);
+    auto assign = [&](size_t t) {
+        Partial& p = partial[t];
+        p.sum.assign(k, {});
+        p.count.assign(k, 0);
+        p.inertia = 0;
+        p.changed = 0;
+        for (size_t i = n * t / threads; i < n * (t + 1) / threads; ++i) {
+            int best = 0;
+            float bestDist = squaredDistance(points[i], result.centroids[0]);
+            for (size_t c = 1; c < k; ++c) {
+                float d = squaredDistance(points[i], result.centroids[c]);
+                if (d < bestDist) {
+                    bestDist = d;
+                    best = static_cast<int>(c);
+                }
+            }
+            if (result.assignment[i] != best) {
+                result.assignment[i] = best;
+                ++p.changed;
+            }
+            p.inertia += bestDist;
+            ++p.count[best];
+            for (size_t j = 0; j < kFeatureDims; ++j)
+                p.sum[best][j] += points[i][j];
+        }
+    };
+
+    while (result.iterations < maxIterations) {
+        ++result.iterations;
+        vector<thread> pool;
+        for (size_t t = 1; t < threads; ++t)
+            pool.emplace_back(assign, t);
+        assign(0);
+        for (auto& t : pool)
+            t.join();
+
+        size_t changed = 0;
+        result.inertia = 0;
+        for (size_t t = 1; t < threads; ++t) {
+            for (size_t c = 0; c < k; ++c) {
+                partial[0].count[c] += partial[t].count[c];
+                for (size_t j = 0; j < kFeatureDims; ++j)
+                    partial[0].sum[c][j] += partial[t].sum[c][j];
+            }
+        }
+        for (const auto& p : partial) {
+            changed += p.changed;
+            result.inertia += p.inertia;
+        }
+        if (changed == 0)
+            break;
+        for (size_t c = 0; c < k; ++c) {
+            if (partial[0].count[c] == 0) {
+                // Empty group: restart it at the point worst served by its centroid
+                size_t worst = 0;
+                float worstDist = -1;
+                for (size_t i = 0; i < n; ++i) {
+                    float d = squaredDistance(points[i], result.centroids[result.assignment[i]]);
+                    if (d > worstDist) {
+                        worstDist = d;
+                        worst = i;
+                    }
+                }
+                result.centroids[c] = points[worst];
+                continue;
+            }
+            for (size_t j = 0; j < kFeatureDims; ++j)
+                result.centroids[c][j] = static_cast<float>(partial[0].sum[c][j] / partial[0].count[c]);
+        }
+    }
+    return result;
+}
+
+// Rough name for a group from its centroid (ratios are to the station mean)
+string describeCluster(const FeatureVector& centroid) {
+    float rush = max(max(centroid[7], centroid[8]), max(centroid[17], centroid[18])) / max(centroid[3], 0.01f);
+    float weekdays = (centroid[24] + centroid[25] + centroid[26] + centroid[27] + centroid[28]) / 5;
+    float weekend = (centroid[29] + centroid[30]) / 2;
+    float heating = centroid[31 + static_cast<size_t>(Season::Winter)] / max(centroid[31 + static_cast<size_t>(Season::Summer)], 0.01f);
+    if (heating > 2)
+        return "heating season dominated";
+    if (rush > 1.3f && weekdays > weekend * 1.1f)
+        return "traffic-like (rush hour peaks)";
+    if (centroid[36] > 3)
+        return "episodic (rare high peaks)";
+    return "background (flat profile)";
+}
+
+// The sensor entry's parameter, from the registry or from the entry itself
+Param sensorParam(const nlohmann::json& sensor) {
+    SensorInfo info;
+    if (sensor.contains("id") && sensor["id"].is_number_integer() && sensorRegistry.find(sensor["id"].get<int>(), info))
+        return info.param;
+    if (sensor.contains("param"))
+        return paramFromCode(sensor["param"].value("paramCode", ""));
+    return paramFromCode(sensor.value("key", ""));
+}
+
+struct StationClusters {
+    vector<int> stationIds; // stations with enough history, parallel to result.assignment
+    size_t skipped = 0;     // stations without a file or with too little data
+    KMeansResult result;
+};
+
+// Groups the catalog stations by their profile of one parameter and stores
+// the group numbers in the catalog (the rest get -1). Station files are
+// parsed in parallel, that is most of the time.
+StationClusters clusterStations(Param param, size_t k) {
+    TraceSpan span("clusterStations");
+    vector<Station> stations = catalog.snapshot();
+    vector<FeatureVector> features(stations.size());
+    vector<char> usable(stations.size(), 0);
+    atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i; (i = next++) < stations.size();) {
+            string filename = to_string(stations[i].id) + ".json";
+            string content;
+            if (!storedFiles.read(filename, content) || content.empty())
+                continue;
+            try {
+                nlohmann::json stationData = nlohmann::json::parse(content);
+                for (const auto& sensor : stationData) {
+                    if (sensor.contains("values") && sensorParam(sensor) == param) {
+                        usable[i] = profileFeatures(seriesFromJson(sensor), features[i]);
+                        break;
+                    }
+                }
+            } catch (nlohmann::json::exception& e) {
+                LOG_WARN("Station {} left out of the groups: {}", stations[i].id, e.what());
             }
         }
-
-        curl_easy_cleanup(curl);
+    };
+    vector<thread> pool;
+    for (size_t t = 1; t < min<size_t>(stations.size(), max(1u, thread::hardware_concurrency())); ++t)
+        pool.emplace_back(work);
+    work();
+    for (auto& t : pool)
+        t.join();
+
+    StationClusters clusters;
+    vector<FeatureVector> points;
+    for (size_t i = 0; i < stations.size(); ++i) {
+        if (usable[i]) {
+            clusters.stationIds.push_back(stations[i].id);
+            points.push_back(features[i]);
+        } else {
+            ++clusters.skipped;
+        }
     }
-    curl_global_cleanup();
+    clusters.result = kMeans(points, k);
+    for (const auto& st : stations)
+        catalog.setCluster(st.id, -1);
+    for (size_t i = 0; i < clusters.stationIds.size(); ++i)
+        catalog.setCluster(clusters.stationIds[i], clusters.result.assignment[i]);
+    LOG_INFO("Grouped {} stations into {} groups by {} profile ({} iterations, {} skipped)", points.size(),
+             clusters.result.centroids.size(), string(kParamCodes[paramIndex(param)]), clusters.result.iterations, clusters.skipped);
+    return clusters;
 }
 
-void init(wxWindow* parent) {
-    // Opening file in C++ (GIVEN JSON)
-    int response;
-    cout<< "hello";
-    ifstream file("findAllmine.json");
-    if (!file.is_open() || file.peek() == ifstream::traits_type::eof()) {
-        file.close();
-        fetchAndSaveData("https://api.gios.gov.pl/pjp-api/rest/station/findAll", "findAllmine.json");
-    } else {
-        // Show a wxMessageDialog for user prompt about data update
-        response = wxMessageBox("Do you wish to download the database?", "Update Database", wxYES_NO | wxICON_QUESTION, parent);
+// Smog episodes: connected groups of (station, hour) exceedances. Two
+// exceedances belong to one episode when they are at the same station at
+// most kEpisodeGapHours apart, or at neighbouring stations (a few nearest
+// within kEpisodeNeighbourKm) in the same or the previous hour. The hours
+// come from the time-major cross-section index in one read per month and
+// are joined with union-find, so two weeks of the whole network take
+// milliseconds and the detector reruns with the hourly checks.
+constexpr int64_t kEpisodeGapHours = 3;
+constexpr double kEpisodeNeighbourKm = 60;
+constexpr size_t kEpisodeNeighbours = 6;
 
-        if (response == wxYES) {
-            file.close();
-            fetchAndSaveData("https://api.gios.gov.pl/pjp-api/rest/station/findAll", "findAllmine.json");
-        } else {
-            cout << "User chose not to update the database.\n";
-        }
+struct SmogEpisode {
+    Param param = Param::Count;
+    int64_t start = 0, end = 0; // UTC, first and last hour above the threshold
+    vector<int> stationIds;
+    size_t stationHours = 0;    // exceedances in the episode
+    double peak = 0;
+    int peakStationId = 0;
+    int64_t peakHour = 0;
+    double minLat = 90, maxLat = -90, minLon = 180, maxLon = -180;
+
+    int64_t hours() const { return (end - start) / 3600 + 1; }
+};
+
+// Union by size with path halving
+class DisjointSets {
+public:
+    size_t add() {
+        parent.push_back(parent.size());
+        size.push_back(1);
+        return parent.size() - 1;
     }
 
-    // Continue with the rest of the logic as before
-    ifstream outFile("database.json");
-    if (response== wxYES ||!outFile.is_open() || outFile.peek() == ifstream::traits_type::eof()) {
-        outFile.close();
-        file.open("findAllmine.json");
-        file.clear();
-        // Creating object called jsonData and inputting into it our json data
-        nlohmann::json jsonData;
-        file >> jsonData;
-        file.close();
+    size_t find(size_t x) {
+        while (parent[x] != x)
+            x = parent[x] = parent[parent[x]];
+        return x;
+    }
+
+    void unite(size_t a, size_t b) {
+        a = find(a);
+        b = find(b);
+        if (a == b)
+            return;
+        if (size[a] < size[b])
+            swap(a, b);
+        parent[b] = a;
+        size[a] += size[b];
+    }
+
+private:
+    vector<size_t> parent, size;
+};
 
-        nlohmann::json jsonDatabase; // Creating json file with cities' names
-        // Accessing specific data
-        for (const auto& station : jsonData) {
-            if (station.contains("city")) {
-                string cityName = station["city"]["name"].get<string>();
-                int id = station["id"].get<int>();
-                string provinceName = station["city"]["commune"]["provinceName"].get<string>();
-                /* */
-                double georgeLat = stod(station["gegrLat"].get<string>());
-                double geogreLon = stod(station["gegrLon"].get<string>());
+// Episodes between fromHour and toHour (UTC, inclusive) with at least
+// minStations stations and minHours hours, newest first. threshold NaN =
+// the start of the "Bad" index level.
+vector<SmogEpisode> detectSmogEpisodes(Param param, int64_t fromHour, int64_t toHour, double threshold = NAN,
+                                       size_t minStations = 2, int64_t minHours = 3) {
+    TraceSpan span("detectSmogEpisodes");
+    if (param == Param::Count || toHour < fromHour)
+        return {};
+    if (isnan(threshold))
+        threshold = kAqiBreakpoints[paramIndex(param)][3];
+    fromHour = floorDiv(fromHour, 3600) * 3600;
+    size_t hours = static_cast<size_t>((toHour - fromHour) / 3600 + 1);
+    vector<int> sensorIds;
+    vector<float> rows;
+    crossSection.snapshotRange(param, fromHour, hours, sensorIds, rows);
 
-                nlohmann::json newEntry;
+    // Columns to stations (the rare station with two sensors of one parameter takes the max)
+    vector<const Station*> stations;
+    unordered_map<int, size_t> stationIndex;
+    vector<int> columnStation(sensorIds.size(), -1);
+    for (size_t c = 0; c < sensorIds.size(); ++c) {
+        SensorInfo info;
+        const Station* st = sensorRegistry.find(sensorIds[c], info) ? catalog.byId(info.stationId) : nullptr;
+        if (!st)
+            continue;
+        auto [it, added] = stationIndex.try_emplace(st->id, stations.size());
+        if (added)
+            stations.push_back(st);
+        columnStation[c] = static_cast<int>(it->second);
+    }
+    vector<vector<size_t>> neighbours(stations.size());
+    for (size_t s = 0; s < stations.size(); ++s) {
+        auto near = catalog.nearestK(stations[s]->lat, stations[s]->lon, kEpisodeNeighbours, [&](const Station& st) {
+            return st.id != stations[s]->id && stationIndex.count(st.id);
+        });
+        for (const auto& [km, st] : near)
+            if (km <= kEpisodeNeighbourKm)
+                neighbours[s].push_back(stationIndex.at(st->id));
+    }
+    // Nearest-k isn't symmetric (a station in a dense area may not be among
+    // the nearest of a lone one next to it), but the join below only looks
+    // through the later station's list, so each pair goes both ways
+    vector<vector<size_t>> nearOf(stations.size());
+    for (size_t s = 0; s < stations.size(); ++s)
+        for (size_t n : neighbours[s])
+            nearOf[n].push_back(s);
+    for (size_t s = 0; s < stations.size(); ++s) {
+        vector<size_t>& list = neighbours[s];
+        list.insert(list.end(), nearOf[s].begin(), nearOf[s].end());
+        sort(list.begin(), list.end());
+        list.erase(unique(list.begin(), list.end()), list.end());
+    }
 
-                newEntry["id"] = id;
-                newEntry["provinceName"] = provinceName;
-                newEntry["cityName"] = cityName;
-                /* */
-                newEntry["gegrLat"]= georgeLat;
-                newEntry["geogrLon"] = geogreLon;
-                jsonDatabase.push_back(newEntry);
-            }
+    struct Exceedance {
+        size_t station;
+        int64_t hour;
+        double value;
+    };
+    vector<Exceedance> nodes;
+    DisjointSets sets;
+    vector<int64_t> lastHour(stations.size(), numeric_limits<int64_t>::min());
+    vector<size_t> lastNode(stations.size(), 0);
+    vector<double> atHour(stations.size());
+    for (size_t h = 0; h < hours; ++h) {
+        int64_t hour = fromHour + static_cast<int64_t>(h) * 3600;
+        fill(atHour.begin(), atHour.end(), NAN);
+        for (size_t c = 0; c < sensorIds.size(); ++c) {
+            float v = rows[h * sensorIds.size() + c];
+            if (columnStation[c] >= 0 && !isnan(v) && !(atHour[columnStation[c]] >= v))
+                atHour[columnStation[c]] = v;
+        }
+        for (size_t s = 0; s < stations.size(); ++s) {
+            if (!(atHour[s] > threshold))
+                continue;
+            size_t node = sets.add();
+            nodes.push_back({s, hour, atHour[s]});
+            if (lastHour[s] != numeric_limits<int64_t>::min() && hour - lastHour[s] <= kEpisodeGapHours * 3600)
+                sets.unite(node, lastNode[s]);
+            // Neighbours checked earlier in this hour or in the previous one
+            for (size_t n : neighbours[s])
+                if (lastHour[n] != numeric_limits<int64_t>::min() && lastHour[n] >= hour - 3600)
+                    sets.unite(node, lastNode[n]);
+            lastHour[s] = hour;
+            lastNode[s] = node;
         }
+    }
 
-        // Writing the JSON data to the file
-        ofstream outFile("database.json");
-        if (!outFile.is_open()) {
-            cerr << "Could not open database.json for writing!" << endl;
+    unordered_map<size_t, SmogEpisode> byRoot;
+    unordered_map<size_t, unordered_set<size_t>> stationsOf;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const Exceedance& x = nodes[i];
+        size_t root = sets.find(i);
+        auto [it, added] = byRoot.try_emplace(root);
+        SmogEpisode& e = it->second;
+        if (added) {
+            e.param = param;
+            e.start = x.hour;
+        }
+        e.end = max(e.end, x.hour);
+        ++e.stationHours;
+        if (x.value > e.peak) {
+            e.peak = x.value;
+            e.peakStationId = stations[x.station]->id;
+            e.peakHour = x.hour;
+        }
+        if (stationsOf[root].insert(x.station).second) {
+            const Station* st = stations[x.station];
+            e.stationIds.push_back(st->id);
+            e.minLat = min(e.minLat, st->lat);
+            e.maxLat = max(e.maxLat, st->lat);
+            e.minLon = min(e.minLon, st->lon);
+            e.maxLon = max(e.maxLon, st->lon);
         }
-        outFile << jsonDatabase.dump(4);  // Indentation of 4 for better readability
     }
-    outFile.close();  // Close the file
+    vector<SmogEpisode> episodes;
+    for (auto& [root, e] : byRoot)
+        if (e.stationIds.size() >= minStations && e.hours() >= minHours)
+            episodes.push_back(move(e));
+    sort(episodes.begin(), episodes.end(), [](const SmogEpisode& a, const SmogEpisode& b) {
+        return a.end != b.end ? a.end > b.end : a.stationIds.size() > b.stationIds.size();
+    });
+    return episodes;
 }
 
+// The hourly outlier and episode check, on its own thread so a long
+// catch-up after a big download doesn't hold the UI. Values come in with a
+// delay, so an hour is checked once it is three hours old. Every hour that
+// got values since the last pass is checked (again), however long ago that
+// was; the first pass, right after startup, also looks at the last three
+// hours stored by the previous run.
+class OutlierChecker {
+public:
+    ~OutlierChecker() { stop(); }
 
+    void start() {
+        if (worker.joinable())
+            return;
+        stopping = false;
+        worker = thread([this] {
+            lowerThreadPriority();
+            bool first = true;
+            do {
+                pass(first);
+                first = false;
+            } while (!sleepFor(chrono::hours(1)));
+        });
+    }
 
+    void stop() {
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable())
+            worker.join();
+    }
 
-void fetchAndSaveSensorData(int stationID, int sensorID) {
-    CURL* curl;
-    CURLcode result;
-    string responseString;
-
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
-
-    if (curl) {
-        string url = "https://api.gios.gov.pl/pjp-api/rest/data/getData/" + to_string(sensorID);
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseString);
+private:
+    thread worker;
+    mutex wakeMutex;
+    condition_variable wake;
+    bool stopping = false;
 
-        result = curl_easy_perform(curl);
+    // true when stop() was called
+    bool sleepFor(chrono::steady_clock::duration d) {
+        unique_lock<mutex> lock(wakeMutex);
+        return wake.wait_for(lock, d, [this] { return stopping; });
+    }
 
-        if (result == CURLE_OK) {
-            try {
-                nlohmann::json newSensorData = nlohmann::json::parse(responseString);
-                
-                string filename = to_string(stationID) + ".json";
-                nlohmann::json stationData;
-                ifstream file(filename);
-                if (file.is_open()) {
-                    file >> stationData;
-                    file.close();
-                } else {
-                    // Create an empty JSON array if the file doesn't exist.
-                    stationData = nlohmann::json::array();
-                }
+    bool stopRequested() {
+        lock_guard<mutex> lock(wakeMutex);
+        return stopping;
+    }
 
-                // Look for sensor data with the specified sensorID.
-                bool sensorFound = false;
-                for (auto& sensor : stationData) {
-                    if (sensor["id"] == sensorID) {
-                        sensorFound = true;
-                        // Iterate through new sensor values.
-                        for (const auto& newValue : newSensorData["values"]) {
-                            // Compare full date string.
-                            string newFullDate = newValue["date"].get<string>();
-                            bool exists = false;
-                            for (const auto& existingValue : sensor["values"]) {
-                                string existingFullDate = existingValue["date"].get<string>();
-                                if (existingFullDate == newFullDate) {
-                                    exists = true;
-                                    break;
-                                }
-                            }
-                            // Append new value if its full date string doesn't already exist.
-                            if (!exists) {
-                                sensor["values"].push_back(newValue);
-                            }
-                        }
-                        break;
-                    }
-                }
+    void pass(bool first) {
+        TraceSpan span("OutlierChecker::pass");
+        int64_t now = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+        int64_t lastHour = floorDiv(now, 3600) * 3600 - 3 * 3600;
+        vector<pair<Param, int64_t>> due;
+        for (size_t p = 0; p < kParamCount; ++p) {
+            vector<int64_t> hours = outlierBacklog.take(p, lastHour);
+            if (first)
+                for (int64_t hour = lastHour - 2 * 3600; hour <= lastHour; hour += 3600)
+                    hours.push_back(hour);
+            sort(hours.begin(), hours.end());
+            hours.erase(unique(hours.begin(), hours.end()), hours.end());
+            for (int64_t hour : hours)
+                due.push_back({static_cast<Param>(p), hour});
+        }
 
-                // If no sensor with sensorID is found, add a new sensor entry.
-                if (!sensorFound) {
-                    nlohmann::json newEntry;
-                    newEntry["id"] = sensorID;
-                    newEntry["values"] = newSensorData["values"];
-                    stationData.push_back(newEntry);
-                }
+        // Hours are independent, one pool for the whole pass
+        vector<vector<OutlierFlag>> found(max(1u, thread::hardware_concurrency()));
+        atomic<size_t> next{0};
+        auto work = [&](vector<OutlierFlag>& out) {
+            for (size_t i; !stopRequested() && (i = next++) < due.size();) {
+                vector<OutlierFlag> flags = detectSpatialOutliers(due[i].first, due[i].second);
+                out.insert(out.end(), flags.begin(), flags.end());
+            }
+        };
+        vector<thread> pool;
+        for (size_t t = 1; t < found.size(); ++t)
+            pool.emplace_back(work, ref(found[t]));
+        work(found[0]);
+        for (auto& t : pool)
+            t.join();
+        vector<OutlierFlag> flags;
+        for (auto& part : found)
+            flags.insert(flags.end(), part.begin(), part.end());
+        storeOutlierFlags(flags);
+        LOG_INFO("Outlier check: {} hours, {} flags", due.size(), flags.size());
 
-                ofstream outFile(filename);
-                if (outFile.is_open()) {
-                    outFile << stationData.dump(4);
-                    outFile.close();
-                }
-            } catch (nlohmann::json::parse_error& e) {
-                cerr << "JSON Parsing Error: " << e.what() << endl;
+        // Particulate episodes still going on
+        for (Param param : {Param::PM10, Param::PM25}) {
+            for (const auto& e : detectSmogEpisodes(param, now - 14 * 86400, now)) {
+                if (e.end < lastHour - kEpisodeGapHours * 3600)
+                    break;
+                LOG_INFO("{} episode: {} stations for {} h since {}, peak {} at station {}", string(kParamCodes[paramIndex(param)]),
+                         e.stationIds.size(), e.hours(), formatTimestamp(warsawTime.utcToLocal(e.start)), e.peak, e.peakStationId);
             }
         }
-
-        curl_easy_cleanup(curl);
     }
-    curl_global_cleanup();
-}
-
+};
 
+OutlierChecker outlierChecker;
 
 /*
 void updateDatabaseWithStationData(int stationID) {
@@ -468,9 +5407,28 @@ void updateDatabaseWithStationData(int stationID) {
 }*/
 
 void updateData(int stationID) {
-    fetchAndSaveData("https://api.gios.gov.pl/pjp-api/rest/station/sensors/" + to_string(stationID), (to_string(stationID)+".json"));
+    TraceSpan span("updateData");
+    string filename = to_string(stationID) + ".json";
+    fetchAndSaveData(apiUrl("station/sensors/" + to_string(stationID)), filename);
+    // The registry follows the sensor list that was just saved
+    string content;
+    try {
+        if (storedFiles.read(filename, content) && !content.empty())
+            sensorRegistry.setStation(stationID, nlohmann::json::parse(content));
+    } catch (nlohmann::json::exception& e) {
+        LOG_WARN("Sensor list of station {} not registered: {}", stationID, e.what());
+    }
 }
 
+// Controls the UI benchmark clicks on, filled in while the windows exist
+struct UiBenchTargets {
+    wxTextCtrl* searchBox = nullptr;
+    wxListBox* resultList = nullptr;
+    wxListBox* sensorList = nullptr;
+    wxButton* applyButton = nullptr;
+};
+UiBenchTargets uiBenchTargets;
+
 class MyFrame : public wxFrame {
 public:
     MyFrame() : wxFrame(nullptr, wxID_ANY, "Professional App", wxDefaultPosition, wxSize(400, 400)) {
@@ -489,67 +5447,86 @@ public:
         sizer->Add(updateBtn, 0, wxALL | wxCENTER, 10);
         updateBtn->Bind(wxEVT_BUTTON, &MyFrame::OnUpdate, this);
 
+        wxButton* worstBtn = new wxButton(panel, wxID_ANY, "Worst Stations");
+        sizer->Add(worstBtn, 0, wxALL | wxCENTER, 10);
+        worstBtn->Bind(wxEVT_BUTTON, &MyFrame::OnWorstStations, this);
+
+        wxButton* groupBtn = new wxButton(panel, wxID_ANY, "Group Stations");
+        sizer->Add(groupBtn, 0, wxALL | wxCENTER, 10);
+        groupBtn->Bind(wxEVT_BUTTON, &MyFrame::OnGroupStations, this);
+
+        wxButton* episodesBtn = new wxButton(panel, wxID_ANY, "Smog Episodes");
+        sizer->Add(episodesBtn, 0, wxALL | wxCENTER, 10);
+        episodesBtn->Bind(wxEVT_BUTTON, &MyFrame::OnSmogEpisodes, this);
+
         resultList = new wxListBox(panel, wxID_ANY, wxDefaultPosition, wxSize(300, 150));
         sizer->Add(resultList, 1, wxEXPAND | wxALL, 10);
         resultList->Bind(wxEVT_LISTBOX_DCLICK, &MyFrame::OnCitySelected, this);
+        uiBenchTargets.searchBox = searchBox;
+        uiBenchTargets.resultList = resultList;
 
         panel->SetSizer(sizer);
+
+        // Pick up catalog updates published by another instance
+        shareTimer.SetOwner(this, wxWindow::NewControlId());
+        Bind(wxEVT_TIMER, &MyFrame::OnShareTimer, this, shareTimer.GetId());
+        shareTimer.Start(2000);
     }
 
 private:
+    wxTimer shareTimer;
     wxTextCtrl* searchBox;
     wxListBox* resultList;
     vector<nlohmann::json> cityResults;
 
     void OnSearch(wxCommandEvent&) {
-        ifstream dataFile("database.json");
-        if (!dataFile.is_open()) {
-            wxMessageBox("Database file not found!", "Error", wxICON_ERROR);
+        TraceSpan span("OnSearch");
+        if (catalog.size() == 0) {
+            messageBox("Database file not found!", "Error", wxICON_ERROR);
             return;
         }
     
-        nlohmann::json dataFromDatabase;
-        dataFile >> dataFromDatabase;
-        dataFile.close();
-    
         wxString input = searchBox->GetValue();
         cityResults.clear();
         resultList->Clear();
     
-        for (const auto& city : dataFromDatabase) {
-            wxString cityName = wxString::FromUTF8(city["cityName"].get<string>());
-            if (cityName.IsSameAs(input, false)) {
-                cityResults.push_back(city);
-                int CityId = city["id"];
-                resultList->Append(cityName + " (" + to_string(CityId) + ")");
-            }
+        // "group:N" lists a group from Group Stations; otherwise exact name
+        // first, then everything starting with the typed text
+        vector<const Station*> found;
+        long group;
+        if (input.StartsWith("group:") && input.Mid(6).ToLong(&group))
+            found = catalog.inCluster(static_cast<int>(group));
+        else
+            found = catalog.findByName(input.utf8_string(), true);
+        if (found.empty() && !input.IsEmpty() && !input.StartsWith("group:"))
+            found = catalog.findByName(input.utf8_string(), false);
+        for (const Station* st : found) {
+            cityResults.push_back(stationToJson(*st));
+            resultList->Append(wxString::FromUTF8(st->cityName) + " (" + to_string(st->id) + ")");
         }
+        if (!cityResults.empty())
+            uiMark("results");
         //COORDINATE INPUT
         if (cityResults.empty()) {
-            wxMessageBox("City not found in database.", "Search Result", wxICON_WARNING);
-            int response = wxMessageBox("Do you wish to search city through coordinates?", "Update Database", wxYES_NO | wxICON_QUESTION, this);
+            messageBox("City not found in database.", "Search Result", wxICON_WARNING);
+            int response = messageBox("Do you wish to search city through coordinates?", "Update Database", wxYES_NO | wxICON_QUESTION, this);
 
             if (response == wxYES) {
                 wxString latStr = wxGetTextFromUser("Enter Latitude:", "Input Coordinates");
                 wxString lonStr = wxGetTextFromUser("Enter Longitude:", "Input Coordinates");
                 
-                double userLat, userLon;
-                if (!latStr.ToDouble(&userLat) || !lonStr.ToDouble(&userLon)) {
-                    wxMessageBox("Invalid coordinates input!", "Error", wxICON_ERROR);
+                double userLat = 0, userLon = 0;
+                if (!parseDecimal(latStr.utf8_string(), userLat) || !parseDecimal(lonStr.utf8_string(), userLon) ||
+                    fabs(userLat) > 90 || fabs(userLon) > 180) {
+                    messageBox("Invalid coordinates input!", "Error", wxICON_ERROR);
                     return;
                 }
                 
-                double minDistance = numeric_limits<double>::max();
-                nlohmann::json closestStation;
-                for (const auto& station : dataFromDatabase) {
-                    double stationLat = station["gegrLat"].get<double>();
-                    double stationLon = station["geogrLon"].get<double>();
-                    double distance = Haversine(userLat, userLon, stationLat, stationLon);
-                    if (distance < minDistance) {
-                        minDistance = distance;
-                        closestStation = station;
-                    }
-                }
+                double minDistance = 0;
+                const Station* closest = catalog.nearest(userLat, userLon, &minDistance);
+                if (!closest)
+                    return;
+                nlohmann::json closestStation = stationToJson(*closest);
                 
                 cityResults.push_back(closestStation);
             int stationID = closestStation["id"].get<int>();
@@ -564,29 +5541,135 @@ private:
                     wxString::FromUTF8(closestStation["provinceName"].get<string>()),
                     closestStation["id"].get<int>(),
                     minDistance);
-                wxMessageBox(msg, "Closest Station", wxICON_INFORMATION);
+                messageBox(msg, "Closest Station", wxICON_INFORMATION);
                 */
             }
             } else {
-                cout << "Naaaah we're going thorug name\n";
+                LOG_DEBUG("search '{}': {} stations by name", input.utf8_string(), cityResults.size());
             }
            
     }
-    double Haversine(double lat1, double lon1, double lat2, double lon2) {
-        const double R = 6371.0; // Earth radius in kilometers
-        const double DEG_TO_RAD = M_PI / 180.0;
-        
-        double dLat = (lat2 - lat1) * DEG_TO_RAD;
-        double dLon = (lon2 - lon1) * DEG_TO_RAD;
-        
-        double a = sin(dLat / 2) * sin(dLat / 2) +
-                   cos(lat1 * DEG_TO_RAD) * cos(lat2 * DEG_TO_RAD) *
-                   sin(dLon / 2) * sin(dLon / 2);
-                   
-        double c = 2 * atan2(sqrt(a), sqrt(1 - a));
-        
-        return R * c;
+    // The 20 stations with the highest 24 h mean of the chosen parameter
+    void OnWorstStations(wxCommandEvent&) {
+        wxDialog* dialog = new wxDialog(this, wxID_ANY, "Worst Stations (24 h mean)", wxDefaultPosition, wxSize(420, 450));
+        wxBoxSizer* vbox = new wxBoxSizer(wxVERTICAL);
+        wxChoice* paramChoice = new wxChoice(dialog, wxID_ANY);
+        for (auto code : kParamCodes)
+            paramChoice->Append(wxString::FromUTF8(string(code)));
+        paramChoice->SetSelection(paramIndex(Param::PM25));
+        wxListBox* ranking = new wxListBox(dialog, wxID_ANY, wxDefaultPosition, wxSize(380, 320));
+        vbox->Add(paramChoice, 0, wxEXPAND | wxALL, 10);
+        vbox->Add(ranking, 1, wxEXPAND | wxALL, 10);
+        vbox->Add(new wxButton(dialog, wxID_OK, "Close"), 0, wxALIGN_CENTER | wxALL, 10);
+
+        auto fill = [paramChoice, ranking] {
+            ranking->Clear();
+            int64_t now = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+            int rank = 0;
+            for (const auto& r : worstStations.top(static_cast<Param>(paramChoice->GetSelection()), 20, now)) {
+                const Station* st = catalog.byId(r.stationId);
+                wxString name = st ? wxString::FromUTF8(st->cityName) : wxString("station " + to_string(r.stationId));
+                ranking->Append(wxString::Format("%d. %s - %.1f (%d h)", ++rank, name, r.mean, r.hours));
+            }
+            if (rank == 0)
+                ranking->Append("No station has enough data in the last 24 h");
+        };
+        fill();
+        paramChoice->Bind(wxEVT_CHOICE, [fill](wxCommandEvent&) { fill(); });
+
+        dialog->SetSizer(vbox);
+        dialog->ShowModal();
+        dialog->Destroy();
+    }
+
+    // Episodes of the last 14 days for the chosen parameter, newest first
+    void OnSmogEpisodes(wxCommandEvent&) {
+        wxDialog* dialog = new wxDialog(this, wxID_ANY, "Smog Episodes (last 14 days)", wxDefaultPosition, wxSize(520, 450));
+        wxBoxSizer* vbox = new wxBoxSizer(wxVERTICAL);
+        wxChoice* paramChoice = new wxChoice(dialog, wxID_ANY);
+        for (auto code : kParamCodes)
+            paramChoice->Append(wxString::FromUTF8(string(code)));
+        paramChoice->SetSelection(paramIndex(Param::PM10));
+        wxListBox* list = new wxListBox(dialog, wxID_ANY, wxDefaultPosition, wxSize(480, 320));
+        vbox->Add(paramChoice, 0, wxEXPAND | wxALL, 10);
+        vbox->Add(list, 1, wxEXPAND | wxALL, 10);
+        vbox->Add(new wxButton(dialog, wxID_OK, "Close"), 0, wxALIGN_CENTER | wxALL, 10);
+
+        auto fill = [paramChoice, list] {
+            list->Clear();
+            int64_t now = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+            Param param = static_cast<Param>(paramChoice->GetSelection());
+            for (const auto& e : detectSmogEpisodes(param, now - 14 * 86400, now)) {
+                const Station* peakAt = catalog.byId(e.peakStationId);
+                list->Append(wxString::Format("%s - %s: %zu stations, %lld h, peak %.0f at %s (%s)",
+                                              formatTimestamp(warsawTime.utcToLocal(e.start)).substr(0, 16),
+                                              formatTimestamp(warsawTime.utcToLocal(e.end)).substr(0, 16), e.stationIds.size(),
+                                              static_cast<long long>(e.hours()), e.peak,
+                                              peakAt ? wxString::FromUTF8(peakAt->cityName) : wxString("?"),
+                                              formatTimestamp(warsawTime.utcToLocal(e.peakHour)).substr(0, 16)));
+            }
+            if (list->IsEmpty())
+                list->Append(wxString::Format("No episode above %.0f in the last 14 days", kAqiBreakpoints[paramIndex(param)][3]));
+        };
+        fill();
+        paramChoice->Bind(wxEVT_CHOICE, [fill](wxCommandEvent&) { fill(); });
+
+        dialog->SetSizer(vbox);
+        dialog->ShowModal();
+        dialog->Destroy();
+    }
+
+    // k-means over the profiles of the downloaded stations; the groups are
+    // saved with the catalog and listed by typing group:N in the search box
+    void OnGroupStations(wxCommandEvent&) {
+        wxArrayString codes;
+        for (auto code : kParamCodes)
+            codes.Add(wxString::FromUTF8(string(code)));
+        int pick = wxGetSingleChoiceIndex("Group the stations by the profile of:", "Group Stations", codes, this);
+        if (pick < 0)
+            return;
+        long k = 0;
+        wxString answer = wxGetTextFromUser("Number of groups (2-12):", "Group Stations", "4", this);
+        if (answer.IsEmpty())
+            return;
+        if (!answer.ToLong(&k) || k < 2 || k > 12) {
+            messageBox("Invalid number of groups!", "Error", wxICON_ERROR);
+            return;
+        }
+
+        StationClusters clusters;
+        {
+            wxBusyCursor busy;
+            clusters = clusterStations(static_cast<Param>(pick), static_cast<size_t>(k));
+        }
+        if (clusters.stationIds.empty()) {
+            messageBox(wxString::Format("No station has %zu days of %s data yet, update some stations first.", kMinProfileHours / 24, codes[pick]),
+                       "Group Stations", wxICON_WARNING);
+            return;
+        }
+        saveDatabase("database.json");
+        sharedSegment.publishCatalog(catalog.snapshot());
+
+        vector<size_t> sizes(clusters.result.centroids.size(), 0);
+        for (int c : clusters.result.assignment)
+            ++sizes[c];
+        wxString msg = wxString::Format("%zu stations grouped by %s profile (%zu without enough data):\n\n", clusters.stationIds.size(),
+                                        codes[pick], clusters.skipped);
+        for (size_t c = 0; c < sizes.size(); ++c)
+            msg += wxString::Format("group:%zu - %zu stations, %s\n", c, sizes[c], describeCluster(clusters.result.centroids[c]));
+        msg += "\nType group:N in the search box to list a group.";
+        messageBox(msg, "Group Stations", wxICON_INFORMATION);
+    }
+
+    void OnShareTimer(wxTimerEvent&) {
+        if (!sharedSegment.isWriter() && sharedSegment.tryBecomeWriter()) {
+            // The previous writer quit, this instance keeps the segment up to date from now on
+            sharedSegment.publishCatalog(catalog.snapshot());
+            return;
+        }
+        syncCatalogFromShared();
     }
+
     void OnCitySelected(wxCommandEvent&) {
         int selection = resultList->GetSelection();
         if (selection != wxNOT_FOUND) {
@@ -596,15 +5679,17 @@ private:
 
     void ShowSensorData(int stationID, int sensorID) {
         string filename = to_string(stationID) + ".json";
-        ifstream stationFile(filename);
+        string content;
         nlohmann::json stationData;
         
-        if (!stationFile.is_open()) {
-            wxMessageBox("Station data not found! Please fetch data first.", "Error", wxICON_ERROR);
+        if (!storedFiles.read(filename, content)) {
+            messageBox("Station data not found! Please fetch data first.", "Error", wxICON_ERROR);
             return;
         }
-        stationFile >> stationData;
-        stationFile.close();
+        {
+            TraceSpan parse("ShowSensorData parse");
+            stationData = nlohmann::json::parse(content);
+        }
     
         // Gather sensor data for the selected sensorID.
         vector<nlohmann::json> fullSensorData;
@@ -614,13 +5699,13 @@ private:
             return elem.contains("values");
         }); it!= stationData.end()){
             
-            int response = wxMessageBox("Do you wish to Download Sensor data?", "Update Database", wxYES_NO | wxICON_QUESTION, this);
+            int response = messageBox("Do you wish to Download Sensor data?", "Update Database", wxYES_NO | wxICON_QUESTION, this);
 
             if (response == wxYES) {
                 fetchAndSaveSensorData(stationID, sensorID);
-                wxMessageBox("Data downloaded. Please reopen to view graph.", "Info", wxICON_INFORMATION);
+                messageBox("Data downloaded. Please reopen to view graph.", "Info", wxICON_INFORMATION);
             } else {
-                cout << "User chose not to update the station database.\n";
+                LOG_INFO("User chose not to update the station database.");
             
         for (const auto& sensor : stationData) {
             if (sensor["id"] == sensorID && sensor.contains("values")) {
@@ -629,8 +5714,19 @@ private:
         }
     
 
+        ShowGraphDialog(fullSensorData, "Sensor Data Graph");
+    }
+    }else{
+        fetchAndSaveSensorData(stationID, sensorID);
+        messageBox("Data downloaded. Please reopen to view graph."+ to_string(stationData.contains("value")), "Info", wxICON_INFORMATION);
+    }
+    }
+    
+    // Dialog with the date range controls and the graph of the given sensors
+    void ShowGraphDialog(const vector<nlohmann::json>& fullSensorData, const wxString& title,
+                         GraphPanel::ChartType chart = GraphPanel::TimeLine) {
         // Create a dialog that contains date controls and the graph.
-        wxDialog* detailsDialog = new wxDialog(this, wxID_ANY, "Sensor Data Graph", wxDefaultPosition, wxSize(900, 700));
+        wxDialog* detailsDialog = new wxDialog(this, wxID_ANY, title, wxDefaultPosition, wxSize(900, 700));
         wxBoxSizer* mainSizer = new wxBoxSizer(wxVERTICAL);
     
         // --- Date range selection controls ---
@@ -642,12 +5738,22 @@ private:
         wxStaticText* endLabel = new wxStaticText(controlPanel, wxID_ANY, "End Date:");
         wxDatePickerCtrl* endDatePicker = new wxDatePickerCtrl(controlPanel, wxID_ANY);
         wxButton* applyButton = new wxButton(controlPanel, wxID_ANY, "Apply Date Range");
+        wxButton* calendarButton = new wxButton(controlPanel, wxID_ANY, "Calendar View");
+        wxChoice* chartChoice = new wxChoice(controlPanel, wxID_ANY);
+        chartChoice->Append("Time line");
+        chartChoice->Append("Daily profile");
+        chartChoice->Append("Weekly profile");
+        chartChoice->Append("Histogram");
+        chartChoice->Append("Scatter");
+        chartChoice->SetSelection(chart);
     
         controlSizer->Add(startLabel, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
         controlSizer->Add(startDatePicker, 0, wxALL, 5);
         controlSizer->Add(endLabel, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
         controlSizer->Add(endDatePicker, 0, wxALL, 5);
         controlSizer->Add(applyButton, 0, wxALL, 5);
+        controlSizer->Add(calendarButton, 0, wxALL, 5);
+        controlSizer->Add(chartChoice, 0, wxALL, 5);
         controlPanel->SetSizer(controlSizer);
         mainSizer->Add(controlPanel, 0, wxEXPAND | wxALL, 10);
     
@@ -655,6 +5761,7 @@ private:
         GraphPanel* graphPanel = new GraphPanel(detailsDialog, fullSensorData);
         graphPanel->SetMinSize(wxSize(1000, 550));
         graphPanel->SetSize(wxSize(1000, 550));
+        graphPanel->SetChart(chart);
         mainSizer->Add(graphPanel, 1, wxEXPAND | wxALL, 10);
     
         // --- Close button ---
@@ -663,6 +5770,7 @@ private:
     
         detailsDialog->SetSizerAndFit(mainSizer);
         detailsDialog->Layout();
+        uiBenchTargets.applyButton = applyButton;
     
         // --- Bind the apply button ---
         applyButton->Bind(wxEVT_BUTTON, [=, &fullSensorData, &graphPanel, &mainSizer, &detailsDialog](wxCommandEvent&) mutable  {
@@ -677,40 +5785,73 @@ private:
             graphPanel = new GraphPanel(detailsDialog, filteredData);
             graphPanel->SetMinSize(wxSize(1000, 550));
             graphPanel->SetSize(wxSize(1000, 550));
+            graphPanel->SetChart(static_cast<GraphPanel::ChartType>(chartChoice->GetSelection()));
             // Insert the new panel back into the sizer (insert at index 1 to keep controls on top).
             mainSizer->Insert(1, graphPanel, 1, wxEXPAND | wxALL, 10);
             detailsDialog->Layout();
         });
     
+        chartChoice->Bind(wxEVT_CHOICE, [&graphPanel, chartChoice](wxCommandEvent&) {
+            graphPanel->SetChart(static_cast<GraphPanel::ChartType>(chartChoice->GetSelection()));
+        });
+        calendarButton->Bind(wxEVT_BUTTON, [this, &fullSensorData, title](wxCommandEvent&) {
+            if (!fullSensorData.empty())
+                ShowCalendarDialog(fullSensorData.front(), title);
+        });
+    
         detailsDialog->ShowModal();
+        uiBenchTargets.applyButton = nullptr;
         detailsDialog->Destroy();
     }
-    }else{
-        fetchAndSaveSensorData(stationID, sensorID);
-        wxMessageBox("Data downloaded. Please reopen to view graph."+ to_string(stationData.contains("value")), "Info", wxICON_INFORMATION);
-    }
+
+    // Heatmap of the whole history of one sensor, years at a glance
+    void ShowCalendarDialog(const nlohmann::json& sensor, const wxString& title) {
+        wxDialog* dialog = new wxDialog(this, wxID_ANY, title + " - Calendar", wxDefaultPosition, wxSize(1000, 650));
+        wxBoxSizer* vbox = new wxBoxSizer(wxVERTICAL);
+        wxChoice* layoutChoice = new wxChoice(dialog, wxID_ANY);
+        layoutChoice->Append("Day x Month");
+        layoutChoice->Append("Hour x Date");
+        layoutChoice->SetSelection(0);
+        HeatmapPanel* heatmap = new HeatmapPanel(dialog, sensor);
+        heatmap->SetMinSize(wxSize(960, 520));
+        layoutChoice->Bind(wxEVT_CHOICE, [heatmap, layoutChoice](wxCommandEvent&) {
+            heatmap->SetLayout(layoutChoice->GetSelection() == 0 ? HeatmapPanel::DayByMonth : HeatmapPanel::HourByDate);
+        });
+        vbox->Add(layoutChoice, 0, wxALL, 10);
+        vbox->Add(heatmap, 1, wxEXPAND | wxALL, 10);
+        vbox->Add(new wxButton(dialog, wxID_OK, "Close"), 0, wxALIGN_CENTER | wxALL, 10);
+        dialog->SetSizerAndFit(vbox);
+        dialog->ShowModal();
+        dialog->Destroy();
     }
-    
+
     vector<nlohmann::json> FilterSensorDataByDateRange(
         const vector<nlohmann::json>& sensorData,
         const wxDateTime& startDate,
         const wxDateTime& endDate)
     {
         vector<nlohmann::json> filteredData;
+        int64_t startDay = daysFromCivil(startDate.GetYear(), startDate.GetMonth() + 1, startDate.GetDay());
+        int64_t endDay = daysFromCivil(endDate.GetYear(), endDate.GetMonth() + 1, endDate.GetDay());
         for (const auto& sensor : sensorData) {
             nlohmann::json sensorCopy;
             sensorCopy["id"] = sensor["id"];
+            if (sensor.contains("param"))
+                sensorCopy["param"] = sensor["param"];
             sensorCopy["values"] = nlohmann::json::array();
             for (const auto& dataEntry : sensor["values"]) {
                 // Skip if "value" is missing or null.
                 if (!dataEntry.contains("value") || dataEntry["value"].is_null())
                     continue;
+                if (!dataEntry.contains("date") || !dataEntry["date"].is_string())
+                    continue;
                 
-                string dateStd = dataEntry.value("date", "1970-01-01");
-                wxString dateStr = wxString::FromUTF8(dateStd.c_str());
-                wxDateTime dt;
-                dt.ParseFormat(dateStr, "%Y-%m-%d");
-                if (dt.IsValid() && dt >= startDate && dt <= endDate) {
+                const string& dateStd = dataEntry["date"].get_ref<const string&>();
+                int64_t t;
+                if (!parseTimestamp(dateStd, t))
+                    continue;
+                int64_t day = floorDiv(t, 86400);
+                if (day >= startDay && day <= endDay) {
                     sensorCopy["values"].push_back(dataEntry);
                 }
             }
@@ -725,30 +5866,97 @@ private:
     void ShowCityDetails(const nlohmann::json& city) {
         int stationID = city["id"].get<int>();
         string filename = to_string(stationID) + ".json";
-        ifstream stationFile(filename);
+        string content;
     
-        if (!stationFile.is_open() || stationFile.peek() == ifstream::traits_type::eof()) {
+        if (!storedFiles.read(filename, content) || content.empty()) {
             updateData(stationID);
-            wxMessageBox("Fetching data... Try again in a few seconds.", "Info", wxICON_INFORMATION);
+            messageBox("Fetching data... Try again in a few seconds.", "Info", wxICON_INFORMATION);
             return;
         }
     
         nlohmann::json stationData;
-        stationFile >> stationData;
-        stationFile.close();
+        {
+            TraceSpan parse("ShowCityDetails parse");
+            stationData = nlohmann::json::parse(content);
+        }
     
         wxDialog* detailsDialog = new wxDialog(this, wxID_ANY, "Sensor Parameters", wxDefaultPosition, wxSize(400, 350));
         wxBoxSizer* vbox = new wxBoxSizer(wxVERTICAL);
         wxListBox* sensorList = new wxListBox(detailsDialog, wxID_ANY, wxDefaultPosition, wxSize(350, 200));
     
         vector<nlohmann::json> sensorDetails;
+        int64_t now = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
         for (auto& sensor : stationData) {
             wxString paramName = wxString::FromUTF8(sensor["param"]["paramName"].get<string>());
+            SharedSegment::Latest latest;
+            if (sharedSegment.readLatest(sensor["id"].get<int>(), latest))
+                paramName += wxString::Format(" - %.1f (%s)", latest.value, formatTimestamp(warsawTime.utcToLocal(latest.time)));
+            // The startup pass may not have got to this station yet
+            SensorQuality quality;
+            if (sensor.contains("values") && !dataQuality.find(sensor["id"].get<int>(), quality)) {
+                dataQuality.scoreSensor(sensor, now);
+                dataQuality.find(sensor["id"].get<int>(), quality);
+            }
+            if (quality.hours > 0)
+                paramName += wxString::Format(" [quality %d]", quality.score);
             sensorList->Append(paramName);
             sensorDetails.push_back(sensor);
         }
     
         vbox->Add(sensorList, 1, wxEXPAND | wxALL, 10);
+        wxButton* derivedButton = new wxButton(detailsDialog, wxID_ANY, "Derived Series...");
+        vbox->Add(derivedButton, 0, wxALIGN_CENTER | wxALL, 5);
+        derivedButton->Bind(wxEVT_BUTTON, [this, stationID, &stationData](wxCommandEvent&) {
+            wxString expression = wxGetTextFromUser("Expression over parameter codes, e.g. PM2.5 / PM10 or rollmean(PM10, 24):", "Derived Series");
+            if (expression.IsEmpty())
+                return;
+            Series result;
+            string error;
+            if (!derivedSeriesCache.get(stationID, stationData, expression.utf8_string(), result, error)) {
+                messageBox(wxString::FromUTF8(error), "Derived Series", wxICON_ERROR);
+                return;
+            }
+            vector<nlohmann::json> graphData{seriesToJson(result, 0, expression.utf8_string())};
+            ShowGraphDialog(graphData, expression);
+        });
+        wxButton* compareButton = new wxButton(detailsDialog, wxID_ANY, "Compare Parameters...");
+        vbox->Add(compareButton, 0, wxALIGN_CENTER | wxALL, 5);
+        compareButton->Bind(wxEVT_BUTTON, [this, detailsDialog, &sensorDetails, &stationData](wxCommandEvent&) {
+            wxArrayString names;
+            for (const auto& sensor : sensorDetails)
+                names.Add(wxString::FromUTF8(sensor["param"]["paramName"].get<string>()));
+            int x = wxGetSingleChoiceIndex("Parameter on the x axis:", "Compare Parameters", names, detailsDialog);
+            int y = x < 0 ? -1 : wxGetSingleChoiceIndex("Parameter on the y axis:", "Compare Parameters", names, detailsDialog);
+            if (x < 0 || y < 0)
+                return;
+            vector<nlohmann::json> pair;
+            for (int pick : {x, y})
+                for (const auto& sensor : stationData)
+                    if (sensor["id"] == sensorDetails[pick]["id"] && sensor.contains("values"))
+                        pair.push_back(sensor);
+            if (pair.size() < 2) {
+                messageBox("Download the data of both sensors first.", "Compare Parameters", wxICON_INFORMATION);
+                return;
+            }
+            ShowGraphDialog(pair, names[x] + " vs " + names[y], GraphPanel::ScatterDensity);
+        });
+        wxButton* qualityButton = new wxButton(detailsDialog, wxID_ANY, "Data Quality...");
+        vbox->Add(qualityButton, 0, wxALIGN_CENTER | wxALL, 5);
+        qualityButton->Bind(wxEVT_BUTTON, [sensorList, &sensorDetails](wxCommandEvent&) {
+            int selection = sensorList->GetSelection();
+            SensorQuality q;
+            if (selection == wxNOT_FOUND || !dataQuality.find(sensorDetails[selection]["id"].get<int>(), q) || q.hours == 0) {
+                messageBox("Select a sensor with downloaded data first.", "Data Quality", wxICON_INFORMATION);
+                return;
+            }
+            messageBox(wxString::Format("Last 30 days: %zu hourly values\n"
+                                        "Coverage: %.1f%%\nLongest gap: %lld h\n"
+                                        "Flat-line hours: %zu\nSpikes: %zu\n"
+                                        "Newest value: %.1f h old\n\nScore: %d / 100",
+                                        q.hours, 100 * q.coverage, static_cast<long long>(q.longestGap), q.flatHours, q.spikes,
+                                        q.latency / 3600.0, q.score),
+                       "Data Quality", wxICON_INFORMATION);
+        });
         wxButton* closeButton = new wxButton(detailsDialog, wxID_OK, "Close");
         vbox->Add(closeButton, 0, wxALIGN_CENTER | wxALL, 10);
     
@@ -763,7 +5971,10 @@ private:
 
     
         detailsDialog->SetSizer(vbox);
+        uiBenchTargets.sensorList = sensorList;
+        detailsDialog->CallAfter([] { uiMark("sensors"); });
         detailsDialog->ShowModal();
+        uiBenchTargets.sensorList = nullptr;
         detailsDialog->Destroy();
     }
     
@@ -776,15 +5987,556 @@ private:
     }
 };
 
+bool uiBenchFailed = false;
+
+// --ui-bench [text]: drives the window like a user would with
+// wxUIActionSimulator and reports how long each step took, from the
+// simulated input to the moment the result was on screen:
+//   type city + Enter -> result list, double-click city -> sensor list,
+//   double-click sensor -> graph painted, Apply -> graph repainted.
+// Meant to run against the testapi/ stand-in (JPO_API_BASE=file://...).
+class UiBenchmark : public wxEvtHandler {
+public:
+    UiBenchmark(wxFrame* frame, const string& query) : frame(frame), query(query), timer(this) {
+        Bind(wxEVT_TIMER, &UiBenchmark::OnTick, this);
+        uiTrace.onMark = [this](const char* name) {
+            if (waiting && expected == name) {
+                results.push_back({step, chrono::duration<double, milli>(chrono::steady_clock::now() - started).count()});
+                waiting = false;
+            }
+        };
+    }
+
+    void Start() { timer.Start(100); }
+
+private:
+    struct Result {
+        string step;
+        double ms;
+    };
+
+    wxFrame* frame;
+    string query;
+    wxTimer timer;
+    wxUIActionSimulator sim;
+    int stage = 0;
+    bool waiting = false;
+    string step, expected;
+    chrono::steady_clock::time_point started, deadline;
+    vector<Result> results;
+    bool failed = false;
+
+    void expect(const string& stepName, const string& mark) {
+        step = stepName;
+        expected = mark;
+        waiting = true;
+        started = chrono::steady_clock::now();
+        deadline = started + chrono::seconds(15);
+    }
+
+    void doubleClickFirstItem(wxListBox* list) {
+        wxRect rect = list->GetScreenRect();
+        sim.MouseMove(wxPoint(rect.x + 20, rect.y + 8));
+        sim.MouseDblClick();
+    }
+
+    // One step per tick; modal dialogs keep the timer running
+    void OnTick(wxTimerEvent&) {
+        if (waiting) {
+            if (chrono::steady_clock::now() > deadline) {
+                cout << "ui-bench: timed out waiting for \"" << expected << "\" in step " << step << "\n";
+                failed = true;
+                finish();
+            }
+            return;
+        }
+        switch (stage++) {
+        case 0:
+            uiBenchTargets.searchBox->SetFocus();
+            expect("type city -> results", "results");
+            sim.Text(query.c_str());
+            sim.Char(WXK_RETURN);
+            break;
+        case 1:
+            expect("double-click city -> sensors", "sensors");
+            doubleClickFirstItem(uiBenchTargets.resultList);
+            break;
+        case 2:
+            if (!uiBenchTargets.sensorList) {
+                --stage;
+                return;
+            }
+            expect("double-click sensor -> graph", "graph");
+            doubleClickFirstItem(uiBenchTargets.sensorList);
+            break;
+        case 3: {
+            if (!uiBenchTargets.applyButton) {
+                --stage;
+                return;
+            }
+            wxRect rect = uiBenchTargets.applyButton->GetScreenRect();
+            expect("apply -> redraw", "graph");
+            sim.MouseMove(wxPoint(rect.x + rect.width / 2, rect.y + rect.height / 2));
+            sim.MouseClick();
+            break;
+        }
+        default:
+            finish();
+        }
+    }
+
+    void finish() {
+        timer.Stop();
+        uiTrace.onMark = nullptr;
+        cout << "\nui-bench latency report\n";
+        for (const auto& r : results)
+            cout << left << setw(34) << r.step << fixed << setprecision(1) << r.ms << " ms\n";
+        // Close whatever is still open, innermost first
+        while (wxWindow* active = wxGetActiveWindow()) {
+            wxDialog* dialog = dynamic_cast<wxDialog*>(active);
+            if (!dialog || dialog == static_cast<wxWindow*>(frame))
+                break;
+            dialog->EndModal(wxID_OK);
+            wxYield();
+        }
+        frame->Close(true);
+        uiBenchFailed = failed;
+    }
+};
+
+// Hardware counters for "--bench --perf", read through perf_event_open.
+// Events the kernel refuses (perf_event_paranoid, VMs without a PMU) are
+// reported as "-"; multiplexed counters are scaled by enabled/running time.
+// Linux only, elsewhere the benchmarks print timings alone.
+#ifdef __linux__
+class PerfCounters {
+public:
+    static constexpr size_t kCount = 5;
+
+    PerfCounters() {
+        const pair<uint32_t, uint64_t> events[kCount] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        };
+        for (size_t i = 0; i < kCount; ++i) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+    }
+
+    ~PerfCounters() {
+        for (int fd : fds)
+            if (fd >= 0)
+                close(fd);
+    }
+
+    bool available() const {
+        return any_of(fds.begin(), fds.end(), [](int fd) { return fd >= 0; });
+    }
+
+    void start() {
+        for (int fd : fds) {
+            if (fd < 0)
+                continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    // cycles, instructions, L1d read misses, LLC misses, branch misses; NaN if unavailable
+    array<double, kCount> stop() {
+        array<double, kCount> counts;
+        for (size_t i = 0; i < kCount; ++i) {
+            counts[i] = NAN;
+            if (fds[i] < 0)
+                continue;
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t raw[3]; // value, time enabled, time running
+            if (read(fds[i], raw, sizeof(raw)) == sizeof(raw) && raw[2] > 0)
+                counts[i] = static_cast<double>(raw[0]) * raw[1] / raw[2];
+        }
+        return counts;
+    }
+
+private:
+    array<int, kCount> fds;
+};
+#else
+class PerfCounters {
+public:
+    static constexpr size_t kCount = 5;
+
+    bool available() const { return false; }
+    void start() {}
+    array<double, kCount> stop() {
+        array<double, kCount> counts;
+        counts.fill(NAN);
+        return counts;
+    }
+};
+#endif
+
+// Benchmarks, run with "--bench" instead of opening the window,
+// "--bench --perf" adds hardware counters per op next to the timings
+volatile double benchSink;
+PerfCounters* benchCounters = nullptr;
+
+template <class F>
+void runBenchmark(const string& name, size_t ops, F&& body) {
+    if (benchCounters)
+        benchCounters->start();
+    auto start = chrono::steady_clock::now();
+    body();
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    cout << left << setw(32) << name << setw(10) << ops << fixed << setprecision(1) << setw(10) << ns / ops;
+    if (benchCounters) {
+        array<double, PerfCounters::kCount> counts = benchCounters->stop();
+        auto column = [](double v) {
+            char text[32];
+            snprintf(text, sizeof(text), "%.1f", v);
+            return isnan(v) ? string("-") : string(text);
+        };
+        cout << setw(10) << column(counts[0] / ops) << setw(10) << column(counts[1] / ops)
+             << setw(6) << column(counts[1] / counts[0]) << setw(10) << column(counts[2] / ops)
+             << setw(10) << column(counts[3] / ops) << column(counts[4] / ops);
+    }
+    cout << "\n";
+}
+
+// Randomized cross-check of the parsing kernels against from_chars / a
+// plain field-by-field parse; returns the number of mismatches
+size_t verifyParsers(size_t rounds) {
+    mt19937_64 rng(12345);
+    size_t mismatches = 0;
+    char buf[64];
+    for (size_t i = 0; i < rounds; ++i) {
+        double expected, got;
+        if (i % 3 == 0) {
+            uint64_t bits = rng();
+            memcpy(&expected, &bits, sizeof(expected));
+            if (!isfinite(expected))
+                continue;
+            snprintf(buf, sizeof(buf), "%.17g", expected);
+        } else {
+            snprintf(buf, sizeof(buf), "%.*f", static_cast<int>(rng() % 10), (rng() % 100000000) / 1e6 - 50);
+        }
+        const char* end = buf + strlen(buf);
+        from_chars(buf, end, expected);
+        if (parseDecimal(buf, end, got) != end || got != expected)
+            ++mismatches;
+
+        unsigned y = 1990 + rng() % 60, mo = 1 + rng() % 12, d = 1 + rng() % 28, h = rng() % 24, mi = rng() % 60, se = rng() % 60;
+        snprintf(buf, sizeof(buf), "%04u-%02u-%02u %02u:%02u:%02u", y, mo, d, h, mi, se);
+        int64_t t;
+        if (!parseTimestamp(buf, 19, t) || t != daysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + se)
+            ++mismatches;
+    }
+    // Out of range for a double: +-inf or +-0 like strtod
+    const pair<const char*, double> extremes[] = {{"1e400", HUGE_VAL}, {"-1e400", -HUGE_VAL}, {"1e-400", 0.0}, {"-2.5e-999", -0.0}};
+    for (const auto& [text, expected] : extremes) {
+        double got = NAN;
+        if (!parseDecimal(string(text), got) || got != expected || signbit(got) != signbit(expected))
+            ++mismatches;
+    }
+    return mismatches;
+}
+
+// A station rule watching two sensors of the same parameter: each sensor
+// keeps its own run, so both fire on the same hours and neither sensor's
+// values complete a run of the other; returns the number of mismatches
+size_t verifyAlerts() {
+    AlertEngine engine;
+    AlertRule rule;
+    rule.stationId = 944;
+    rule.param = Param::PM10;
+    rule.threshold = 50;
+    rule.hours = 2;
+    engine.add(rule);
+    const int64_t t0 = daysFromCivil(2025, 4, 3) * 86400;
+    auto fired = [&](int sensorId, initializer_list<pair<int64_t, double>> samples) {
+        vector<AlertEvent> events = engine.evaluate(944, sensorId, Param::PM10, samples);
+        return events.empty() ? int64_t(-1) : (events.back().time - t0) / 3600;
+    };
+    size_t mismatches = 0;
+    // Sensor A: above at hours 0-3, fires at hour 1
+    mismatches += fired(6085, {{t0, 60}, {t0 + 3600, 70}, {t0 + 7200, 80}, {t0 + 10800, 90}}) != 1;
+    // Sensor B, same hours, only seen after A moved on: fires at hour 1 too
+    mismatches += fired(6086, {{t0, 55}, {t0 + 3600, 65}}) != 1;
+    // Sensor C: one hour above after A's four is not a run of two
+    mismatches += fired(6087, {{t0 + 14400, 99}}) != -1;
+    // B again: the next hour continues B's own run, which already fired
+    mismatches += fired(6086, {{t0 + 7200, 75}}) != -1;
+    return mismatches;
+}
+
+void runBenchmarks(bool perf) {
+    cout << "parser cross-check mismatches: " << verifyParsers(1000000) << "\n";
+    cout << "alert cross-check mismatches: " << verifyAlerts() << "\n";
+
+    unique_ptr<PerfCounters> counters;
+    if (perf) {
+        counters = make_unique<PerfCounters>();
+        if (counters->available())
+            benchCounters = counters.get();
+        else
+            cout << "perf_event_open not permitted (see /proc/sys/kernel/perf_event_paranoid), timings only\n";
+    }
+    cout << left << setw(32) << "benchmark" << setw(10) << "ops" << setw(10) << "ns/op";
+    if (benchCounters)
+        cout << setw(10) << "cyc/op" << setw(10) << "ins/op" << setw(6) << "IPC" << setw(10) << "L1d/op" << setw(10) << "LLC/op" << "brmiss/op";
+    cout << "\n";
+
+    const size_t n = 200000;
+    mt19937_64 rng(7);
+    vector<string> coords, dates;
+    for (size_t i = 0; i < n; ++i) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.6f", 49.0 + (rng() % 6000000) / 1e6);
+        coords.push_back(buf);
+        snprintf(buf, sizeof(buf), "2025-%02u-%02u %02u:00:00", unsigned(1 + rng() % 12), unsigned(1 + rng() % 28), unsigned(rng() % 24));
+        dates.push_back(buf);
+    }
+
+    runBenchmark("parse coords: stod", n, [&] {
+        double sum = 0;
+        for (const auto& c : coords)
+            sum += stod(c);
+        benchSink = sum;
+    });
+    runBenchmark("parse coords: parseDecimal", n, [&] {
+        double sum = 0;
+        for (const auto& c : coords) {
+            double v = 0;
+            parseDecimal(c, v);
+            sum += v;
+        }
+        benchSink = sum;
+    });
+    runBenchmark("parse dates: wxDateTime", n, [&] {
+        double sum = 0;
+        for (const auto& d : dates) {
+            wxDateTime dt;
+            dt.ParseFormat(wxString::FromUTF8(d), "%Y-%m-%d %H:%M:%S");
+            sum += dt.GetTicks();
+        }
+        benchSink = sum;
+    });
+    runBenchmark("parse dates: parseTimestamp", n, [&] {
+        double sum = 0;
+        for (const auto& d : dates) {
+            int64_t t = 0;
+            parseTimestamp(d, t);
+            sum += t;
+        }
+        benchSink = sum;
+    });
+
+    // merge: a month of hourly values already stored, three days fetched,
+    // one of them new. After the first round nothing is appended, which is
+    // what most refreshes look like.
+    const int64_t hour = 3600, first = warsawTime.localToUtc(daysFromCivil(2025, 1, 1) * 86400);
+    auto hourlyValues = [&](int64_t from, size_t count) {
+        nlohmann::json values = nlohmann::json::array();
+        for (size_t i = 0; i < count; ++i)
+            values.push_back({{"date", formatTimestamp(warsawTime.utcToLocal(from + i * hour))}, {"value", (rng() % 1000) / 10.0}});
+        return values;
+    };
+    nlohmann::json stationData = nlohmann::json::array({{{"id", 1}, {"values", hourlyValues(first, 720)}}});
+    nlohmann::json fetched = hourlyValues(first + 696 * hour, 72);
+    vector<int64_t> fetchedTimes = batchTimesUtc(fetched);
+    const size_t mergeRounds = 200;
+    runBenchmark("merge: 72 into 720 values", mergeRounds * 72, [&] {
+        size_t added = 0;
+        for (size_t r = 0; r < mergeRounds; ++r) {
+            Param param = Param::PM10;
+            added += mergeSensorValues(stationData, 1, fetched, fetchedTimes, param).size();
+        }
+        benchSink = added;
+    });
+
+    // filter: catalog lookups over a synthetic country of stations
+    vector<Station> stations;
+    const char* prefixes[] = {"Poznań", "Kraków", "Warszawa", "Gdańsk", "Wrocław", "Łódź", "Lublin", "Katowice"};
+    for (int i = 0; i < 5000; ++i) {
+        Station st;
+        st.id = i + 1;
+        st.cityName = string(prefixes[i % 8]) + "-" + to_string(i);
+        st.province = static_cast<Province>(i % static_cast<int>(Province::Count));
+        st.lat = 49.0 + (rng() % 5000000) / 1e6;
+        st.lon = 14.1 + (rng() % 10000000) / 1e6;
+        stations.push_back(st);
+    }
+    StationCatalog catalog;
+    catalog.load(stations);
+    const size_t lookups = 20000;
+    runBenchmark("filter: name prefix", lookups, [&] {
+        size_t found = 0;
+        for (size_t i = 0; i < lookups; ++i)
+            found += catalog.findByName(string(prefixes[i % 8]).substr(0, 3 + i % 3), false).size();
+        benchSink = found;
+    });
+    runBenchmark("filter: nearest station", lookups, [&] {
+        double sum = 0;
+        for (size_t i = 0; i < lookups; ++i)
+            sum += catalog.nearest(49.0 + (i % 500) / 100.0, 14.1 + (i % 997) / 100.0)->id;
+        benchSink = sum;
+    });
+    runBenchmark("filter: province", lookups, [&] {
+        size_t found = 0;
+        for (size_t i = 0; i < lookups; ++i)
+            found += catalog.inProvince(static_cast<Province>(i % static_cast<int>(Province::Count))).size();
+        benchSink = found;
+    });
+
+    // trend: the regression behind the graph's "Trend:" line
+    vector<double> series(100000);
+    for (auto& v : series)
+        v = (rng() % 1000) / 10.0;
+    runBenchmark("trend: 100k values", 20 * series.size(), [&] {
+        size_t rising = 0;
+        for (int r = 0; r < 20; ++r)
+            rising += calculateTrend(series) == "Rising";
+        benchSink = rising;
+    });
+
+    // profiles: a year of hourly values for 300 stations, bucketed in parallel
+    vector<vector<int64_t>> profileTimes(300);
+    vector<vector<double>> profileValues(300);
+    vector<ProfileInput> profileInputs;
+    for (size_t i = 0; i < profileTimes.size(); ++i) {
+        for (int64_t h = 0; h < 8760; ++h) {
+            profileTimes[i].push_back(first + h * hour);
+            profileValues[i].push_back(rng() % 20 == 0 ? NAN : (rng() % 1000) / 10.0);
+        }
+        profileInputs.push_back({profileTimes[i].data(), profileValues[i].data(), profileTimes[i].size()});
+    }
+    runBenchmark("profile: 300 stations x 1 year", 300 * 8760, [&] {
+        vector<Profile> profiles = buildProfiles(profileInputs);
+        benchSink = profiles[0].hourMean(kSeasonCount, 8);
+    });
+
+    // rolling: regulatory windows over a year of one station, O(1) per hour
+    Series yearly;
+    for (size_t h = 0; h < profileTimes[0].size(); ++h)
+        yearly.push(profileTimes[0][h], profileValues[0][h], !isnan(profileValues[0][h]));
+    runBenchmark("rolling: 24 h mean + 8 h max, 1 year", 2 * yearly.size(), [&] {
+        benchSink = rollingSeries(yearly, Rolling::Mean, 24).value[100] + rollingSeries(yearly, Rolling::Max, 8).value[100];
+    });
+
+    // histogram and scatter density: a million points binned per pixel
+    vector<double> pointsX(1000000), pointsY(1000000);
+    for (size_t i = 0; i < pointsX.size(); ++i) {
+        pointsX[i] = (rng() % 100000) / 1000.0;
+        pointsY[i] = pointsX[i] * 0.7 + (rng() % 20000) / 1000.0;
+    }
+    runBenchmark("histogram: 1M values, 40 bins", pointsX.size(), [&] {
+        benchSink = buildHistogram(pointsX.data(), pointsX.size(), 40).counts[7];
+    });
+    runBenchmark("scatter: 1M points, 900x470 px", pointsX.size(), [&] {
+        benchSink = densityGrid(pointsX.data(), pointsY.data(), pointsX.size(), 0, 100, 0, 90, 900, 470)[1000];
+    });
+
+    // checksum: what a first read of a station file pays on top of parsing
+    string blob = stationData.dump(4);
+    runBenchmark("crc32c: station file (bytes)", 100 * blob.size(), [&] {
+        uint32_t crc = 0;
+        for (int r = 0; r < 100; ++r)
+            crc ^= crc32c(blob.data(), blob.size());
+        benchSink = crc;
+    });
+
+    // render: a month of one sensor drawn into an offscreen bitmap
+    wxFrame* hidden = new wxFrame(nullptr, wxID_ANY, "bench");
+    nlohmann::json sensor = {{"id", 1}, {"param", {{"paramCode", "PM10"}}}, {"values", stationData[0]["values"]}};
+    GraphPanel* panel = new GraphPanel(hidden, {sensor});
+    panel->SetSize(wxSize(1000, 700));
+    wxBitmap bitmap(1000, 700);
+    wxMemoryDC dc(bitmap);
+    const size_t frames = 50;
+    runBenchmark("render: graph 1000x700", frames, [&] {
+        for (size_t i = 0; i < frames; ++i)
+            panel->Render(dc);
+    });
+    dc.SelectObject(wxNullBitmap);
+    hidden->Destroy();
+}
+
 class MyApp : public wxApp {
 public:
     virtual bool OnInit() {
         wxSetlocale(LC_ALL, "en-US.UTF-8");
+        if (argc > 1 && argv[1] == "--bench") {
+            runBenchmarks(argc > 2 && argv[2] == "--perf");
+            return false;
+        }
+        // Once for the whole process, before any thread can start a transfer
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        bool uiBench = argc > 1 && argv[1] == "--ui-bench";
+        unattended = uiBench;
         MyFrame* frame = new MyFrame();
+        if (alertEngine.load("alerts.json"))
+            LOG_INFO("Loaded {} alert rules", alertEngine.size());
         init(frame);
         frame->Show(true);
+        const char* stallMs = getenv("JPO_STALL_MS");
+        stallWatchdog.start(frame, stallMs ? atoi(stallMs) : 500);
+        RetentionPolicy retention;
+        if (const char* rawDays = getenv("JPO_RAW_DAYS"))
+            retention.rawDays = max(1, atoi(rawDays));
+        compactor.start(retention);
+        vector<int> stationIds;
+        for (const auto& st : catalog.snapshot())
+            stationIds.push_back(st.id);
+        dataQuality.start(stationIds);
+        // Stations the registry doesn't know yet get their sensor lists downloaded
+        sensorRegistry.load("sensors.json");
+        if (sharedSegment.isWriter() || sensorRegistry.size() == 0) {
+            vector<int> missing;
+            for (const auto& st : catalog.snapshot())
+                if (!sensorRegistry.knowsStation(st.id))
+                    missing.push_back(st.id);
+            if (!missing.empty())
+                sensorRegistry.syncAll(missing, "sensors.json");
+        }
+        // Needs the catalog and the registry loaded above
+        outlierChecker.start();
+        if (uiBench) {
+            // Station and sensor files are fetched up front, only the UI is timed
+            updateData(944);
+            fetchAndSaveSensorData(944, 6085);
+            UiBenchmark* bench = new UiBenchmark(frame, argc > 2 ? argv[2].utf8_string() : "Pozna");
+            bench->Start();
+        }
         return true;
     }
+
+    int OnExit() override {
+        stallWatchdog.stop();
+        outlierChecker.stop();
+        sensorRegistry.stop();
+        curl_global_cleanup();
+        dataQuality.stop();
+        compactor.stop();
+        storedFiles.stop();
+        asyncLogger.stop();
+        return wxApp::OnExit();
+    }
+
+    // --ui-bench exits with 1 when a step timed out
+    int OnRun() override {
+        int code = wxApp::OnRun();
+        return uiBenchFailed ? 1 : code;
+    }
 };
 
 wxIMPLEMENT_APP(MyApp);